@@ -3,9 +3,159 @@
 #include "../Entity/Todo.hpp"
 #include "../Persistence/InMemory/InMemoryTodoRepository.hpp"
 #include "../Persistence/CsvFiles/CSVHandler.hpp"
+#include "../Persistence/WalFiles/WriteAheadLog.hpp"
+#include "../Persistence/SnapshotFiles/SnapshotHandler.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <iostream>
 
 class TodoManager {
 public:
+    // storage settings, applied before the repository is first used
+    static void configure(std::size_t shards) {
+        InMemoryTodoRepository::configure(shards);
+    }
+
+    static void configure_change_log(std::size_t capacity) {
+        InMemoryTodoRepository::configure_change_log(capacity);
+    }
+
+    // Loads the snapshot, replays the journal records it does not cover,
+    // then journals every later mutation. Either file may be left unset.
+    static void open_storage(std::optional<std::string> snapshot, std::optional<WriteAheadLog::Options> wal) {
+        InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
+        std::uint64_t last_lsn = 0;
+        if (snapshot) {
+            last_lsn = SnapshotHandler::load(*snapshot);
+            std::cout << "Snapshot: loaded " << repo.size() << " todos from " << *snapshot << std::endl;
+            snapshot_path() = std::move(*snapshot);
+        }
+        if (!wal) return;
+
+        std::size_t records = 0;
+        const std::uint64_t replayed = WriteAheadLog::replay(wal->path, [&](const WriteAheadLog::Record &record) {
+            if (record.lsn <= last_lsn) return; // already in the snapshot
+            apply(repo, record);
+            ++records;
+        });
+        std::cout << "WAL: replayed " << records << " records from " << wal->path << std::endl;
+
+        journal() = std::make_unique<WriteAheadLog>(std::move(*wal), std::max(last_lsn, replayed));
+        repo.attach_journal(journal().get());
+    }
+
+    // Takes a final checkpoint, then detaches and flushes the journal; call once no request is in flight
+    static void close_storage() {
+        wait_checkpoint();
+        if (!snapshot_path().empty()) {
+            try {
+                write_checkpoint(SnapshotHandler::capture(journal().get()));
+            } catch (const std::exception &e) {
+                std::cerr << "Snapshot: final checkpoint failed: " << e.what() << std::endl;
+            }
+        }
+        InMemoryTodoRepository::instance().attach_journal(nullptr);
+        journal().reset();
+    }
+
+    // Removes todos once they are `grace` past due, checking every `interval`.
+    // Each pass drains the due prefix of every shard in slices of `slice` todos per lock hold.
+    static void start_expiry(std::chrono::seconds grace, std::chrono::milliseconds interval, std::size_t slice = 1024) {
+        auto &state = expiry_state();
+        std::lock_guard lock(state.mutex);
+        if (state.worker.joinable()) return;
+
+        state.stop = false;
+        state.worker = std::thread([grace, interval, slice] {
+            auto &state = expiry_state();
+            std::unique_lock lock(state.mutex);
+            while (!state.wake.wait_for(lock, interval, [&] { return state.stop; })) {
+                lock.unlock();
+                try {
+                    const auto now = std::chrono::system_clock::now().time_since_epoch();
+                    const auto cutoff = std::chrono::duration_cast<std::chrono::seconds>(now - grace).count();
+                    if (cutoff > 0) {
+                        std::size_t removed;
+                        do {
+                            removed = InMemoryTodoRepository::instance().expire(static_cast<uint64_t>(cutoff), slice);
+                        } while (removed > 0 && !stopping());
+                    }
+                } catch (const std::exception &e) {
+                    std::cerr << "Expiry: pass failed: " << e.what() << std::endl;
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    static void stop_expiry() {
+        auto &state = expiry_state();
+        {
+            std::lock_guard lock(state.mutex);
+            state.stop = true;
+        }
+        state.wake.notify_all();
+        if (state.worker.joinable()) state.worker.join();
+    }
+
+    enum class CheckpointResult { started, busy, disabled };
+
+    // Copies the repository and writes the snapshot on a background thread, so the caller
+    // returns at once; once it is durable the journal drops the records it covers
+    static CheckpointResult checkpoint() {
+        if (snapshot_path().empty()) return CheckpointResult::disabled;
+
+        std::lock_guard lock(checkpoint_state().mutex);
+        auto &state = checkpoint_state();
+        if (state.running) return CheckpointResult::busy;
+        if (state.worker.joinable()) state.worker.join();
+
+        state.running = true;
+        try {
+            state.worker = std::thread([]() {
+                try {
+                    write_checkpoint(SnapshotHandler::capture(journal().get()));
+                } catch (const std::exception &e) {
+                    std::cerr << "Snapshot: checkpoint failed: " << e.what() << std::endl;
+                }
+                checkpoint_state().running = false;
+            });
+        } catch (...) {
+            state.running = false;
+            throw;
+        }
+        return CheckpointResult::started;
+    }
+
+    static std::size_t size() {
+        return InMemoryTodoRepository::instance().size();
+    }
+
+    // changes whenever the store does, see InMemoryTodoRepository::generation
+    static std::uint64_t generation() {
+        return InMemoryTodoRepository::instance().generation();
+    }
+
+    // recent mutations for incremental sync, see ChangeLog
+    static ChangeLog &changes() {
+        return InMemoryTodoRepository::instance().changes();
+    }
+
+    // true once the journal has failed and writes are refused, see WriteAheadLog::fail
+    static bool journal_failed() {
+        return journal() && journal()->failed();
+    }
+
+    static InMemoryTodoRepository::LockStats lock_stats() {
+        return InMemoryTodoRepository::instance().lock_stats();
+    }
+
     static bool add_todo(const Todo& todo) {
         return InMemoryTodoRepository::instance().add(todo);
     }
@@ -22,6 +172,15 @@ public:
         return InMemoryTodoRepository::instance().erase(name);
     }
 
+    using Operation = InMemoryTodoRepository::Operation;
+    using OperationResult = InMemoryTodoRepository::OperationResult;
+    using Filter = InMemoryTodoRepository::Filter;
+
+    // mixed create / get / erase / upsert batch, one lock acquisition per shard
+    static std::vector<OperationResult> apply_batch(const std::vector<Operation>& ops) {
+        return InMemoryTodoRepository::instance().apply(ops);
+    }
+
     static void erase_expired(uint64_t before) {
         InMemoryTodoRepository::instance().erase_before(before);
     }
@@ -30,15 +189,121 @@ public:
         return InMemoryTodoRepository::instance().range_before(ts);
     }
 
+    // one page of [from, to), resuming after the last todo of the previous page
+    static InMemoryTodoRepository::Page range_page(uint64_t from, uint64_t to, std::size_t limit,
+                                                   const std::optional<Todo>& after = std::nullopt) {
+        return InMemoryTodoRepository::instance().range_page(from, to, limit, after);
+    }
+
+    // one page of names starting with prefix (and containing needle), in name order
+    static InMemoryTodoRepository::Page search(std::string_view prefix, std::optional<std::string_view> needle,
+                                               std::size_t limit, const std::optional<Todo>& after = std::nullopt) {
+        return InMemoryTodoRepository::instance().search(prefix, needle, limit, after);
+    }
+
+    // one page of todos by tag and / or minimum priority, highest priority first
+    static InMemoryTodoRepository::Page query(const Filter& filter, std::size_t limit,
+                                              const std::optional<Todo>& after = std::nullopt) {
+        return InMemoryTodoRepository::instance().query(filter, limit, after);
+    }
+
     static std::vector<Todo> all() {
         return InMemoryTodoRepository::instance().unsafe_get_all();
     }
 
-    static void load_from_csv(std::istream& is, bool clear_before = true) {
-        CSVHandler::load(is, clear_before);
+    static std::size_t load_from_csv(std::istream& is, bool clear_before = true) {
+        return CSVHandler::load(is, clear_before);
+    }
+
+    static std::size_t load_from_csv(std::string_view csv, bool clear_before = true) {
+        return CSVHandler::load(csv, clear_before);
+    }
+
+    // for bodies parsed while they arrive: feed() chunks, then finish()
+    static CsvImporter csv_importer(bool clear_before = true) {
+        return CsvImporter(clear_before);
     }
 
     static void save_to_csv(std::ostream& os) {
         CSVHandler::save(os);
     }
+
+    // chunk-by-chunk export, see CSVHandler::ExportCursor
+    static CSVHandler::ExportCursor csv_export() {
+        return CSVHandler::export_cursor();
+    }
+
+private:
+    struct CheckpointState {
+        std::mutex mutex;
+        std::thread worker;
+        std::atomic<bool> running = false;
+    };
+
+    struct ExpiryState {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread worker;
+        bool stop = false;
+    };
+
+    static ExpiryState &expiry_state() {
+        static ExpiryState state;
+        return state;
+    }
+
+    static bool stopping() {
+        std::lock_guard lock(expiry_state().mutex);
+        return expiry_state().stop;
+    }
+
+    static std::unique_ptr<WriteAheadLog> &journal() {
+        static std::unique_ptr<WriteAheadLog> wal;
+        return wal;
+    }
+
+    static std::string &snapshot_path() {
+        static std::string path;
+        return path;
+    }
+
+    static CheckpointState &checkpoint_state() {
+        static CheckpointState state;
+        return state;
+    }
+
+    static void wait_checkpoint() {
+        std::lock_guard lock(checkpoint_state().mutex);
+        if (checkpoint_state().worker.joinable()) checkpoint_state().worker.join();
+    }
+
+    static void write_checkpoint(const SnapshotHandler::Image &image) {
+        SnapshotHandler::write(snapshot_path(), image);
+        if (journal()) journal()->compact(image.mark);
+        std::cout << "Snapshot: wrote " << image.todos.size() << " todos at lsn " << image.mark.lsn << std::endl;
+    }
+
+    static void apply(InMemoryTodoRepository &repo, const WriteAheadLog::Record &record) {
+        switch (record.op) {
+            case WriteAheadLog::Op::add:
+                repo.add(WriteAheadLog::decode_todo(record.payload));
+                break;
+            case WriteAheadLog::Op::erase: {
+                const auto name = WriteAheadLog::decode<jh::pod::array<char, 64>>(record.payload);
+                repo.erase(std::string_view(name.data, strnlen(name.data, jh::pod::array<char, 64>::size())));
+                break;
+            }
+            case WriteAheadLog::Op::erase_before:
+                repo.erase_before(WriteAheadLog::decode<uint64_t>(record.payload));
+                break;
+            case WriteAheadLog::Op::batch_add:
+                repo.batch_add(WriteAheadLog::decode_batch(record.payload));
+                break;
+            case WriteAheadLog::Op::clear:
+                repo.clear();
+                break;
+            default:
+                throw std::runtime_error("WAL: unknown record type");
+        }
+    }
 };
@@ -0,0 +1,315 @@
+// Microbenchmarks of the store, CSV, JSON and date code paths.
+//
+//   TodoBench [--sizes 10000,100000,1000000] [--reps 5] [--filter <substring>]
+//
+// Prints one JSON object per line: a `meta` line describing the run, then one line per
+// benchmark and dataset size with the median of `reps` timed repetitions. Inputs come from
+// a fixed seed, so runs on the same machine are comparable.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../Entity/Todo.hpp"
+#include "../Persistence/InMemory/InMemoryTodoRepository.hpp"
+#include "../Persistence/InMemory/FlatNameMap.hpp"
+#include "../Persistence/CsvFiles/CSVHandler.hpp"
+#include "../Web/JsonWriter.hpp"
+
+namespace {
+    struct Options {
+        std::vector<std::size_t> sizes{10000, 100000, 1000000};
+        std::size_t reps = 5;
+        std::string filter;
+    };
+
+    struct Result {
+        double ns_per_op;
+        std::size_t ops;
+        std::size_t bytes; // processed per repetition, 0 when not a throughput benchmark
+    };
+
+    Options options;
+
+    // Times `body` `reps` times after an untimed `setup` each; body returns {ops, bytes}
+    void run(const char *name, std::size_t size, const std::function<void()> &setup,
+             const std::function<std::pair<std::size_t, std::size_t>()> &body) {
+        if (!options.filter.empty() && std::string_view(name).find(options.filter) == std::string_view::npos) return;
+
+        std::vector<Result> results;
+        for (std::size_t r = 0; r < options.reps; ++r) {
+            if (setup) setup();
+            const auto start = std::chrono::steady_clock::now();
+            const auto [ops, bytes] = body();
+            const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            results.push_back({ns / static_cast<double>(std::max<std::size_t>(ops, 1)), ops, bytes});
+        }
+        std::sort(results.begin(), results.end(), [](const Result &a, const Result &b) { return a.ns_per_op < b.ns_per_op; });
+        const Result &median = results[results.size() / 2];
+
+        std::printf("{\"benchmark\":\"%s\",\"size\":%zu,\"ops\":%zu,\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f",
+                    name, size, median.ops, median.ns_per_op, 1e9 / median.ns_per_op);
+        if (median.bytes) {
+            const double seconds = median.ns_per_op * static_cast<double>(median.ops) * 1e-9;
+            std::printf(",\"bytes\":%zu,\"mb_per_sec\":%.1f", median.bytes, static_cast<double>(median.bytes) / seconds / 1e6);
+        }
+        std::printf("}\n");
+        std::fflush(stdout);
+    }
+
+    std::vector<Todo> make_todos(std::size_t n) {
+        std::mt19937_64 rng(42);
+        std::vector<Todo> todos(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::string name = "todo-" + std::to_string(i) + "-" + std::to_string(rng() % 1000000);
+            std::memcpy(todos[i].name.data, name.data(), name.size());
+            todos[i].due_timestamp = 1700000000 + rng() % (365 * 86400);
+        }
+        return todos;
+    }
+
+    // a sample of n names in random order, for lookups
+    std::vector<std::string> shuffled_names(const std::vector<Todo> &todos, std::size_t n) {
+        std::mt19937_64 rng(7);
+        std::vector<std::string> names;
+        names.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) names.emplace_back(todos[rng() % todos.size()].name_view());
+        return names;
+    }
+
+    // the former istringstream / get_time / timegm parser, for comparison
+    uint64_t parse_date_get_time(const std::string &date_str) {
+        std::tm tm{};
+        std::istringstream ss(date_str);
+        if (date_str.size() == 10) {
+            ss >> std::get_time(&tm, "%Y-%m-%d");
+        } else if (date_str.size() >= 16) {
+            ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+            if (ss.fail()) {
+                ss.clear();
+                ss.str(date_str);
+                ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M");
+            }
+        } else {
+            throw std::invalid_argument("Invalid due_date format");
+        }
+        if (ss.fail()) throw std::invalid_argument("Failed to parse due_date");
+        return static_cast<uint64_t>(timegm(&tm));
+    }
+
+    volatile uint64_t sink; // keeps results observable
+
+    void repository(std::size_t n) {
+        auto &repo = InMemoryTodoRepository::instance();
+        const auto todos = make_todos(n);
+        const auto names = shuffled_names(todos, n);
+        std::vector<uint64_t> times;
+        for (const auto &todo: todos) times.push_back(todo.due_timestamp);
+        std::nth_element(times.begin(), times.begin() + static_cast<std::ptrdiff_t>(n / 2), times.end());
+        const uint64_t median_time = times[n / 2];
+
+        auto fill = [&] {
+            repo.clear();
+            repo.batch_add(todos);
+        };
+
+        run("repo_add", n, [&] { repo.clear(); }, [&] {
+            for (const auto &todo: todos) repo.add(todo);
+            return std::pair{n, std::size_t{0}};
+        });
+        run("repo_batch_add", n, [&] { repo.clear(); }, [&] {
+            repo.batch_add(todos);
+            return std::pair{n, std::size_t{0}};
+        });
+
+        fill();
+        run("repo_get", n, nullptr, [&] {
+            uint64_t found = 0;
+            for (const auto &name: names) found += repo.get(name).has_value();
+            sink = found;
+            return std::pair{n, std::size_t{0}};
+        });
+        const std::size_t scans = std::max<std::size_t>(1, 1000000 / n);
+        run("repo_range_before", n, nullptr, [&] {
+            for (std::size_t i = 0; i < scans; ++i) sink = repo.range_before(median_time).size();
+            return std::pair{scans, std::size_t{0}};
+        });
+        // one 100-row page per op: a prefix seek, then a needle scanned over every name
+        const std::size_t pages = std::max<std::size_t>(1, 100000 / n);
+        run("repo_search_prefix", n, nullptr, [&] {
+            for (std::size_t i = 0; i < pages * 100; ++i) sink = repo.search(names[i % n].substr(0, 7), std::nullopt, 100).todos.size();
+            return std::pair{pages * 100, std::size_t{0}};
+        });
+        run("repo_search_contains", n, nullptr, [&] {
+            for (std::size_t i = 0; i < pages; ++i) sink = repo.search("", std::string_view("-99999"), 100).todos.size();
+            return std::pair{pages, std::size_t{0}};
+        });
+        // one 100-row page of "tag X due before T by priority", and of "priority >= 2 due before T"
+        std::vector<Todo> tagged = todos;
+        for (std::size_t i = 0; i < n; ++i) {
+            tagged[i].priority = static_cast<uint8_t>(i % 4);
+            add_tag(tagged[i].tags, "t" + std::to_string(i % 16));
+        }
+        repo.clear();
+        repo.batch_add(tagged);
+        run("repo_query_tag", n, nullptr, [&] {
+            InMemoryTodoRepository::Filter filter;
+            filter.to = median_time;
+            for (std::size_t i = 0; i < pages * 100; ++i) {
+                const std::string tag = "t" + std::to_string(i % 16);
+                filter.tag = tag;
+                sink = repo.query(filter, 100).todos.size();
+            }
+            return std::pair{pages * 100, std::size_t{0}};
+        });
+        run("repo_query_priority", n, nullptr, [&] {
+            InMemoryTodoRepository::Filter filter;
+            filter.min_priority = 2;
+            filter.to = median_time;
+            for (std::size_t i = 0; i < pages * 100; ++i) sink = repo.query(filter, 100).todos.size();
+            return std::pair{pages * 100, std::size_t{0}};
+        });
+        run("repo_erase_before", n, fill, [&] {
+            const std::size_t before = repo.size();
+            repo.erase_before(median_time);
+            return std::pair{before - repo.size(), std::size_t{0}}; // per removed todo
+        });
+
+        fill();
+        std::ostringstream saved;
+        CSVHandler::save(saved);
+        const std::string csv = saved.str();
+        run("csv_save", n, nullptr, [&] {
+            std::ostringstream os;
+            CSVHandler::save(os);
+            return std::pair{n, os.str().size()};
+        });
+        run("csv_load", n, [&] { repo.clear(); }, [&] {
+            CSVHandler::load(std::string_view(csv), true);
+            return std::pair{n, csv.size()};
+        });
+        repo.clear();
+    }
+
+    void json(std::size_t n) {
+        const auto todos = make_todos(std::min<std::size_t>(n, 100000));
+        std::vector<std::string> bodies;
+        for (const auto &todo: todos) bodies.push_back(boost::json::serialize(to_json(todo)));
+
+        run("json_to_json", todos.size(), nullptr, [&] {
+            std::size_t bytes = 0;
+            for (const auto &todo: todos) bytes += boost::json::serialize(to_json(todo)).size();
+            return std::pair{todos.size(), bytes};
+        });
+        run("json_writer", todos.size(), nullptr, [&] {
+            std::string out;
+            json_writer::append_todos(out, todos);
+            return std::pair{todos.size(), out.size()};
+        });
+        run("json_parse_todo", todos.size(), nullptr, [&] {
+            uint64_t total = 0;
+            for (const auto &body: bodies) total += parse_todo_from_json(boost::json::parse(body).as_object()).due_timestamp;
+            sink = total;
+            return std::pair{todos.size(), std::size_t{0}};
+        });
+    }
+
+    void dates(std::size_t n) {
+        std::vector<std::string> inputs;
+        const auto todos = make_todos(std::min<std::size_t>(n, 100000));
+        for (const auto &todo: todos) {
+            const std::string iso = timestamp_to_iso_string(todo.due_timestamp);
+            switch (inputs.size() % 3) {
+                case 0: inputs.push_back(iso.substr(0, 10)); break;
+                case 1: inputs.push_back(iso.substr(0, 19)); break;
+                default: inputs.push_back(iso.substr(0, 19) + ".250Z"); break;
+            }
+        }
+
+        run("date_parse_get_time", inputs.size(), nullptr, [&] {
+            uint64_t total = 0;
+            for (const auto &date: inputs) total += parse_date_get_time(date);
+            sink = total;
+            return std::pair{inputs.size(), std::size_t{0}};
+        });
+        run("date_parse_civil", inputs.size(), nullptr, [&] {
+            uint64_t total = 0;
+            for (const auto &date: inputs) total += parse_date_string_to_timestamp(date);
+            sink = total;
+            return std::pair{inputs.size(), std::size_t{0}};
+        });
+        run("date_format_iso", todos.size(), nullptr, [&] {
+            std::string out;
+            for (const auto &todo: todos) append_iso_timestamp(out, todo.due_timestamp);
+            return std::pair{todos.size(), out.size()};
+        });
+    }
+
+    // the name index as built (64-byte POD keys, flat table) against std::unordered_map<std::string>
+    void name_maps(std::size_t n) {
+        const auto todos = make_todos(n);
+        const auto names = shuffled_names(todos, n);
+
+        FlatNameMap<uint64_t> flat;
+        std::unordered_map<std::string, uint64_t> std_map;
+        run("name_map_flat_insert", n, [&] { flat.clear(); }, [&] {
+            for (const auto &todo: todos) flat.try_emplace(todo.name, todo.due_timestamp);
+            return std::pair{n, std::size_t{0}};
+        });
+        run("name_map_std_string_insert", n, [&] { std_map.clear(); }, [&] {
+            for (const auto &todo: todos) std_map.try_emplace(std::string(todo.name_view()), todo.due_timestamp);
+            return std::pair{n, std::size_t{0}};
+        });
+        run("name_map_flat_find", n, nullptr, [&] {
+            uint64_t found = 0;
+            for (const auto &name: names) found += flat.find(std::string_view(name)) != nullptr;
+            sink = found;
+            return std::pair{n, std::size_t{0}};
+        });
+        run("name_map_std_string_find", n, nullptr, [&] {
+            uint64_t found = 0;
+            for (const auto &name: names) found += std_map.find(name) != std_map.end();
+            sink = found;
+            return std::pair{n, std::size_t{0}};
+        });
+    }
+
+    std::vector<std::size_t> parse_sizes(const std::string &list) {
+        std::vector<std::size_t> sizes;
+        std::stringstream ss(list);
+        for (std::string item; std::getline(ss, item, ',');) {
+            if (!item.empty()) sizes.push_back(std::max<std::size_t>(1, std::stoul(item)));
+        }
+        return sizes;
+    }
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view flag = argv[i];
+        if (flag == "--sizes") options.sizes = parse_sizes(argv[i + 1]);
+        else if (flag == "--reps") options.reps = std::max<std::size_t>(1, std::stoul(argv[i + 1]));
+        else if (flag == "--filter") options.filter = argv[i + 1];
+        else {
+            std::fprintf(stderr, "usage: %s [--sizes n,n,...] [--reps n] [--filter substring]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::printf("{\"meta\":{\"shards\":%zu,\"hardware_threads\":%u,\"reps\":%zu}}\n",
+                InMemoryTodoRepository::instance().shard_count(), std::thread::hardware_concurrency(), options.reps);
+    for (const std::size_t n: options.sizes) {
+        repository(n);
+        name_maps(n);
+        json(n);
+        dates(n);
+    }
+    return 0;
+}
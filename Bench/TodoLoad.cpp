@@ -0,0 +1,459 @@
+// HTTP load generator for TodoAPP.
+//
+//   TodoLoad [--host 127.0.0.1] [--port 8080] [--connections 16] [--threads 1] [--duration 10] [--timeout 10]
+//            [--rate 0] [--mix create=40,get=50,before=5,all=4,export=1] [--fresh] [--gzip] [--preload 10000] [--json]
+//
+// --rate 0 runs closed-loop: every connection sends its next request as soon as the previous
+// answer arrived. --rate R runs open-loop: R requests per second in total, each connection on a
+// fixed schedule. Open-loop latency is measured from the time a request was *scheduled*, not
+// sent, so a stalled server is charged for the requests it delayed (coordinated omission);
+// the service time (send to answer) is reported next to it.
+#include <boost/beast.hpp>
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    enum class Op { create, get, before, all, export_ };
+
+    constexpr std::pair<const char *, Op> op_names[] = {
+            {"create", Op::create}, {"get", Op::get}, {"before", Op::before}, {"all", Op::all}, {"export", Op::export_},
+    };
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        std::string port = "8080";
+        std::size_t connections = 16;
+        std::size_t threads = 1;
+        std::chrono::seconds duration{10};
+        std::chrono::seconds timeout{10}; // per connect, write and read; a timeout counts as a socket error
+        double rate = 0; // requests per second over all connections, 0 = closed loop
+        std::vector<std::pair<Op, unsigned>> mix{{Op::create, 40}, {Op::get, 50}, {Op::before, 5}, {Op::all, 4}, {Op::export_, 1}};
+        bool fresh = false; // a new connection per request instead of keep-alive
+        bool gzip = false;  // ask for compressed responses
+        std::size_t preload = 10000;
+        bool json = false;
+        std::string run_tag; // keeps created names unique across runs against one server
+
+        static Options parse(int argc, char **argv) {
+            Options o;
+            for (int i = 1; i < argc; ++i) {
+                const std::string_view flag = argv[i];
+                if (flag == "--fresh") {
+                    o.fresh = true;
+                    continue;
+                }
+                if (flag == "--gzip") {
+                    o.gzip = true;
+                    continue;
+                }
+                if (flag == "--json") {
+                    o.json = true;
+                    continue;
+                }
+                if (i + 1 >= argc) throw std::invalid_argument("missing value for " + std::string(flag));
+                const std::string value = argv[++i];
+                if (flag == "--host") o.host = value;
+                else if (flag == "--port") o.port = value;
+                else if (flag == "--connections") o.connections = std::max<std::size_t>(1, std::stoul(value));
+                else if (flag == "--threads") o.threads = std::max<std::size_t>(1, std::stoul(value));
+                else if (flag == "--duration") o.duration = std::chrono::seconds(std::stoul(value));
+                else if (flag == "--timeout") o.timeout = std::chrono::seconds(std::max<unsigned long>(1, std::stoul(value)));
+                else if (flag == "--rate") o.rate = std::stod(value);
+                else if (flag == "--mix") o.mix = parse_mix(value);
+                else if (flag == "--preload") o.preload = std::stoul(value);
+                else throw std::invalid_argument("unknown option " + std::string(flag));
+            }
+            o.threads = std::min(o.threads, o.connections);
+            return o;
+        }
+
+        static std::vector<std::pair<Op, unsigned>> parse_mix(const std::string &text) {
+            std::vector<std::pair<Op, unsigned>> mix;
+            std::size_t pos = 0;
+            while (pos < text.size()) {
+                const auto comma = std::min(text.find(',', pos), text.size());
+                const std::string item = text.substr(pos, comma - pos);
+                const auto eq = item.find('=');
+                const std::string name = item.substr(0, eq);
+                const auto it = std::find_if(std::begin(op_names), std::end(op_names), [&](const auto &p) { return name == p.first; });
+                if (it == std::end(op_names) || eq == std::string::npos) throw std::invalid_argument("bad mix entry " + item);
+                mix.emplace_back(it->second, std::stoul(item.substr(eq + 1)));
+                pos = comma + 1;
+            }
+            return mix;
+        }
+    };
+
+    // HDR-style histogram over microseconds: 32 linear sub-buckets per power of two (~3% error)
+    class Histogram {
+    public:
+        void record(Clock::duration latency) {
+            const auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(
+                    0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+            ++counts_[index_of(us)];
+            ++count_;
+            sum_us_ += us;
+            max_us_ = std::max(max_us_, us);
+        }
+
+        void merge(const Histogram &other) {
+            for (std::size_t i = 0; i < bucket_count; ++i) counts_[i] += other.counts_[i];
+            count_ += other.count_;
+            sum_us_ += other.sum_us_;
+            max_us_ = std::max(max_us_, other.max_us_);
+        }
+
+        // highest value equivalent to the p-th percentile, in microseconds
+        std::uint64_t percentile(double p) const {
+            if (count_ == 0) return 0;
+            const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(p / 100.0 * static_cast<double>(count_))));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                seen += counts_[i];
+                if (seen >= rank) return std::min(upper_of(i), max_us_);
+            }
+            return max_us_;
+        }
+
+        std::uint64_t count() const { return count_; }
+
+        std::uint64_t max() const { return max_us_; }
+
+        double mean() const { return count_ ? static_cast<double>(sum_us_) / static_cast<double>(count_) : 0; }
+
+    private:
+        static constexpr std::size_t sub_bits = 5;
+        static constexpr std::size_t sub = 1 << sub_bits;
+        static constexpr std::size_t bucket_count = (42 - sub_bits + 1) * sub;
+
+        std::vector<std::uint64_t> counts_ = std::vector<std::uint64_t>(bucket_count);
+        std::uint64_t count_ = 0, sum_us_ = 0, max_us_ = 0;
+
+        static std::size_t index_of(std::uint64_t us) {
+            if (us < sub) return us;
+            const auto msb = static_cast<std::size_t>(std::bit_width(us) - 1);
+            return std::min(bucket_count - 1, (msb - sub_bits + 1) * sub + ((us >> (msb - sub_bits)) & (sub - 1)));
+        }
+
+        static std::uint64_t upper_of(std::size_t index) {
+            if (index < sub) return index;
+            const std::size_t msb = index / sub + sub_bits - 1;
+            return ((sub + index % sub + 1) << (msb - sub_bits)) - 1;
+        }
+    };
+
+    struct Stats {
+        Histogram corrected; // from the scheduled start (open loop) or the send (closed loop)
+        Histogram service;   // from the send
+        std::uint64_t ok = 0, http_errors = 0, socket_errors = 0, bytes = 0;
+
+        void merge(const Stats &other) {
+            corrected.merge(other.corrected);
+            service.merge(other.service);
+            ok += other.ok;
+            http_errors += other.http_errors;
+            socket_errors += other.socket_errors;
+            bytes += other.bytes;
+        }
+    };
+
+    // One connection issuing requests until the deadline, one at a time
+    class Client : public std::enable_shared_from_this<Client> {
+    public:
+        Client(net::io_context &ioc, const Options &options, const tcp::resolver::results_type &endpoints,
+               Stats &stats, std::size_t id, Clock::time_point start, Clock::time_point deadline)
+                : options_(options), endpoints_(endpoints), stats_(stats), stream_(ioc), timer_(ioc),
+                  rng_(id * 7919 + 1), id_(id), start_(start), deadline_(deadline) {
+            if (options.rate > 0) {
+                interval_ = std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(static_cast<double>(options.connections) / options.rate));
+                // spread the connections' schedules over one interval
+                start_ += interval_ * static_cast<long>(id) / static_cast<long>(options.connections);
+            }
+            for (const auto &[op, weight]: options.mix) total_weight_ += weight;
+        }
+
+        void run() { next(); }
+
+    private:
+        const Options &options_;
+        const tcp::resolver::results_type &endpoints_;
+        Stats &stats_;
+        beast::tcp_stream stream_;
+        net::steady_timer timer_;
+        beast::flat_buffer buffer_;
+        http::request<http::string_body> req_;
+        std::optional<http::response_parser<http::string_body>> parser_;
+        std::mt19937_64 rng_;
+        std::size_t id_;
+        std::uint64_t created_ = 0;
+        unsigned total_weight_ = 0;
+        Clock::time_point start_, deadline_, intended_, sent_;
+        Clock::duration interval_{};
+        std::uint64_t scheduled_ = 0;
+        bool connected_ = false;
+
+        void next() {
+            if (interval_.count() == 0) {
+                intended_ = Clock::now();
+                if (intended_ >= deadline_) return close();
+                return issue();
+            }
+            intended_ = start_ + interval_ * static_cast<long>(scheduled_++);
+            if (intended_ >= deadline_) return close();
+            if (intended_ <= Clock::now()) return issue(); // behind schedule: the wait counts as latency
+
+            timer_.expires_at(intended_);
+            timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+                if (!ec) self->issue();
+            });
+        }
+
+        void issue() {
+            build_request();
+            sent_ = Clock::now();
+            if (connected_) return write();
+            stream_.expires_after(options_.timeout);
+            stream_.async_connect(endpoints_, [self = shared_from_this()](beast::error_code ec, const tcp::endpoint &) {
+                if (ec) return self->failed();
+                self->connected_ = true;
+                self->write();
+            });
+        }
+
+        void write() {
+            stream_.expires_after(options_.timeout);
+            http::async_write(stream_, req_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                if (ec) return self->failed();
+                self->read();
+            });
+        }
+
+        void read() {
+            parser_.emplace();
+            parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+            stream_.expires_after(options_.timeout);
+            http::async_read(stream_, buffer_, *parser_, [self = shared_from_this()](beast::error_code ec, std::size_t bytes) {
+                if (ec) return self->failed();
+                self->done(bytes);
+            });
+        }
+
+        void done(std::size_t bytes) {
+            const auto now = Clock::now();
+            const auto &res = parser_->get();
+            stats_.service.record(now - sent_);
+            stats_.corrected.record(now - intended_);
+            stats_.bytes += bytes;
+            if (res.result_int() < 400) ++stats_.ok;
+            else ++stats_.http_errors;
+            if (options_.fresh || !res.keep_alive()) disconnect();
+            next();
+        }
+
+        void failed() {
+            ++stats_.socket_errors;
+            disconnect();
+            if (Clock::now() < deadline_) next();
+        }
+
+        void disconnect() {
+            beast::error_code ec;
+            stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+            stream_.close();
+            buffer_.clear();
+            connected_ = false;
+        }
+
+        void close() {
+            if (connected_) disconnect();
+        }
+
+        Op pick() {
+            auto roll = static_cast<unsigned>(rng_() % std::max(1u, total_weight_));
+            for (const auto &[op, weight]: options_.mix) {
+                if (roll < weight) return op;
+                roll -= weight;
+            }
+            return options_.mix.front().first;
+        }
+
+        void build_request() {
+            req_ = {};
+            req_.version(11);
+            req_.set(http::field::host, options_.host);
+            req_.keep_alive(!options_.fresh);
+            if (options_.gzip) req_.set(http::field::accept_encoding, "gzip");
+
+            const auto due = 1700000000 + rng_() % (365 * 86400);
+            switch (pick()) {
+                case Op::create:
+                    req_.method(http::verb::post);
+                    req_.target("/todo_create");
+                    req_.set(http::field::content_type, "application/json");
+                    req_.body() = R"({"name":"load-)" + options_.run_tag + "-" + std::to_string(id_) + "-" + std::to_string(created_++) +
+                                  R"(","due_date":)" + std::to_string(due) + "}";
+                    break;
+                case Op::get:
+                    req_.method(http::verb::get);
+                    req_.target("/todo_get?name=seed-" + std::to_string(rng_() % std::max<std::size_t>(1, options_.preload)));
+                    break;
+                case Op::before:
+                    req_.method(http::verb::post);
+                    req_.target("/todo_before");
+                    req_.set(http::field::content_type, "application/json");
+                    req_.body() = R"({"before":)" + std::to_string(due) + "}";
+                    break;
+                case Op::all:
+                    req_.method(http::verb::get);
+                    req_.target("/todo_all");
+                    break;
+                case Op::export_:
+                    req_.method(http::verb::get);
+                    req_.target("/todo_export");
+                    break;
+            }
+            req_.prepare_payload();
+        }
+    };
+
+    // upserts seed-0 .. seed-(n-1) through /todo_batch so that gets find something
+    void preload(const Options &options, const tcp::resolver::results_type &endpoints) {
+        if (options.preload == 0) return;
+        net::io_context ioc;
+        beast::tcp_stream stream(ioc);
+        stream.connect(endpoints);
+        beast::flat_buffer buffer;
+        std::mt19937_64 rng(42);
+
+        constexpr std::size_t chunk = 5000;
+        for (std::size_t first = 0; first < options.preload; first += chunk) {
+            std::string body = "[";
+            for (std::size_t i = first; i < std::min(options.preload, first + chunk); ++i) {
+                if (i != first) body += ',';
+                body += R"({"op":"upsert","name":"seed-)" + std::to_string(i) + R"(","due_date":)" +
+                        std::to_string(1700000000 + rng() % (365 * 86400)) + "}";
+            }
+            body += ']';
+
+            http::request<http::string_body> req{http::verb::post, "/todo_batch", 11};
+            req.set(http::field::host, options.host);
+            req.set(http::field::content_type, "application/json");
+            req.body() = std::move(body);
+            req.prepare_payload();
+            http::write(stream, req);
+
+            http::response_parser<http::string_body> parser;
+            parser.body_limit(std::numeric_limits<std::uint64_t>::max());
+            http::read(stream, buffer, parser);
+            if (parser.get().result_int() != 200) {
+                throw std::runtime_error("preload failed: HTTP " + std::to_string(parser.get().result_int()));
+            }
+        }
+    }
+
+    void report(const Options &options, const Stats &stats, double seconds) {
+        const double total = static_cast<double>(stats.corrected.count());
+        const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+        if (options.json) {
+            auto hist = [&](const Histogram &h) {
+                std::string out = "{";
+                for (double p: percentiles) {
+                    char buf[64];
+                    std::snprintf(buf, sizeof(buf), "\"p%g\":%llu,", p, static_cast<unsigned long long>(h.percentile(p)));
+                    out += buf;
+                }
+                char buf[96];
+                std::snprintf(buf, sizeof(buf), "\"mean\":%.1f,\"max\":%llu}", h.mean(), static_cast<unsigned long long>(h.max()));
+                return out + buf;
+            };
+            std::printf("{\"mode\":\"%s\",\"connections\":%zu,\"fresh\":%s,\"seconds\":%.3f,\"requests\":%llu,"
+                        "\"requests_per_sec\":%.1f,\"ok\":%llu,\"http_errors\":%llu,\"socket_errors\":%llu,\"bytes\":%llu,"
+                        "\"latency_us\":%s,\"service_time_us\":%s}\n",
+                        options.rate > 0 ? "open" : "closed", options.connections, options.fresh ? "true" : "false", seconds,
+                        static_cast<unsigned long long>(stats.corrected.count()), total / seconds,
+                        static_cast<unsigned long long>(stats.ok), static_cast<unsigned long long>(stats.http_errors),
+                        static_cast<unsigned long long>(stats.socket_errors), static_cast<unsigned long long>(stats.bytes),
+                        hist(stats.corrected).c_str(), hist(stats.service).c_str());
+            return;
+        }
+
+        std::printf("%s loop, %zu connections (%s), %.1f s\n", options.rate > 0 ? "Open" : "Closed", options.connections,
+                    options.fresh ? "fresh" : "keep-alive", seconds);
+        if (options.rate > 0) std::printf("Target rate: %.1f req/s\n", options.rate);
+        std::printf("Requests: %.0f (%.1f req/s), ok %llu, HTTP errors %llu, socket errors %llu, %.1f MB read\n",
+                    total, total / seconds, static_cast<unsigned long long>(stats.ok),
+                    static_cast<unsigned long long>(stats.http_errors), static_cast<unsigned long long>(stats.socket_errors),
+                    static_cast<double>(stats.bytes) / 1e6);
+        std::printf("\n%-10s %14s %14s\n", "Latency", options.rate > 0 ? "corrected(us)" : "(us)", "service(us)");
+        for (double p: percentiles) {
+            std::printf("p%-9g %14llu %14llu\n", p, static_cast<unsigned long long>(stats.corrected.percentile(p)),
+                        static_cast<unsigned long long>(stats.service.percentile(p)));
+        }
+        std::printf("%-10s %14.1f %14.1f\n", "mean", stats.corrected.mean(), stats.service.mean());
+        std::printf("%-10s %14llu %14llu\n", "max", static_cast<unsigned long long>(stats.corrected.max()),
+                    static_cast<unsigned long long>(stats.service.max()));
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = Options::parse(argc, argv);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\nusage: %s [--host h] [--port p] [--connections n] [--threads n] [--duration s] [--timeout s]\n"
+                             "       [--rate r] [--mix create=40,get=50,before=5,all=4,export=1] [--fresh] [--gzip] [--preload n] [--json]\n",
+                     e.what(), argv[0]);
+        return 2;
+    }
+
+    try {
+        net::io_context resolver_ioc;
+        const auto endpoints = tcp::resolver(resolver_ioc).resolve(options.host, options.port);
+        options.run_tag = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        preload(options, endpoints);
+
+        std::vector<Stats> stats(options.threads);
+        std::vector<std::thread> threads;
+        const auto start = Clock::now();
+        const auto deadline = start + options.duration;
+        for (std::size_t t = 0; t < options.threads; ++t) {
+            threads.emplace_back([&, t] {
+                net::io_context ioc(1);
+                for (std::size_t c = t; c < options.connections; c += options.threads) {
+                    std::make_shared<Client>(ioc, options, endpoints, stats[t], c, start, deadline)->run();
+                }
+                ioc.run();
+            });
+        }
+        for (auto &thread: threads) thread.join();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        Stats total;
+        for (const auto &s: stats) total.merge(s);
+        report(options, total, seconds);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "TodoLoad: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -3,28 +3,92 @@
 #include <string>
 #include <string_view>
 #include <cstdint>
-#include <sstream>
-#include <chrono>
-#include <iomanip>
-#include <ctime> // Unix Only for timegm
+#include <cstring>
+#include <array>
+#include <stdexcept>
+#include <ctime>
 #include <boost/json.hpp>
 
 #pragma once
 #include <jh/pod>
 #include <string_view>
 #include <cstdint>
+#include <cstddef>
+
+// Tags of a todo packed as "a,b,c", zero padded
+using TodoTags = jh::pod::array<char, 23>;
+
+// Everything of a todo but its name: the value of the name index
+struct TodoDetails {
+    uint64_t due_timestamp = UINT64_MAX;
+    TodoTags tags{};
+    uint8_t priority = 0;
+
+    bool operator==(const TodoDetails& other) const noexcept {
+        return due_timestamp == other.due_timestamp && priority == other.priority &&
+               std::memcmp(tags.data, other.tags.data, TodoTags::size()) == 0;
+    }
+};
 
 struct Todo final {
     jh::pod::array<char, 64> name{};
     uint64_t due_timestamp = UINT64_MAX;
+    TodoTags tags{};
+    uint8_t priority = 0; // 0 (none) .. 255, higher first in priority order
 
     [[nodiscard]] std::string_view name_view() const {
         return (name[63] == '\0')
                ? std::string_view(name.begin())
                : std::string_view(name.begin(), 64);
     }
+
+    [[nodiscard]] std::string_view tags_view() const {
+        return {tags.data, strnlen(tags.data, TodoTags::size())};
+    }
+
+    [[nodiscard]] TodoDetails details() const noexcept {
+        return {due_timestamp, tags, priority};
+    }
+
+    static Todo make(const jh::pod::array<char, 64>& name, const TodoDetails& details) noexcept {
+        return {name, details.due_timestamp, details.tags, details.priority};
+    }
 };
 
+// Records written before priority and tags existed hold the leading name and due time only
+inline constexpr std::size_t legacy_todo_size = 72;
+static_assert(sizeof(Todo) == 96 && offsetof(Todo, tags) == legacy_todo_size);
+
+// Calls f(offset, size) for every tag of packed tags
+template<typename F>
+void for_each_tag(const TodoTags& tags, F&& f) {
+    const std::size_t end = strnlen(tags.data, TodoTags::size());
+    for (std::size_t start = 0; start < end;) {
+        const auto comma = static_cast<const char*>(std::memchr(tags.data + start, ',', end - start));
+        const std::size_t stop = comma ? static_cast<std::size_t>(comma - tags.data) : end;
+        f(start, stop - start);
+        start = stop + 1;
+    }
+}
+
+// Appends tag to packed tags unless already there; throws when it is malformed or does not fit
+inline void add_tag(TodoTags& tags, std::string_view tag) {
+    if (tag.empty()) throw std::invalid_argument("Empty tag");
+    for (const char c : tag) {
+        if (c == ',' || static_cast<unsigned char>(c) < 0x20) throw std::invalid_argument("Invalid tag");
+    }
+    bool present = false;
+    for_each_tag(tags, [&](std::size_t offset, std::size_t size) {
+        present = present || std::string_view(tags.data + offset, size) == tag;
+    });
+    if (present) return;
+
+    std::size_t used = strnlen(tags.data, TodoTags::size());
+    if ((used ? used + 1 : 0) + tag.size() > TodoTags::size()) throw std::invalid_argument("Tags too long");
+    if (used) tags[used++] = ',';
+    std::memcpy(tags.data + used, tag.data(), tag.size());
+}
+
 
 
 struct TodoNameHash {
@@ -72,13 +136,135 @@ struct TodoNameEqual {
     }
 };
 
+// Orders by due time, then by name bytes (names are zero padded, so this is lexicographic)
+struct TodoTimeLess {
+    bool operator()(const Todo& a, const Todo& b) const noexcept {
+        if (a.due_timestamp != b.due_timestamp) return a.due_timestamp < b.due_timestamp;
+        return std::memcmp(a.name.data, b.name.data, jh::pod::array<char, 64>::size()) < 0;
+    }
+};
 
-inline std::string timestamp_to_iso_string(uint64_t timestamp) {
+// Orders by name bytes only; names are unique, so no tie-break is needed
+struct TodoNameLess {
+    bool operator()(const jh::pod::array<char, 64>& a, const jh::pod::array<char, 64>& b) const noexcept {
+        return std::memcmp(a.data, b.data, jh::pod::array<char, 64>::size()) < 0;
+    }
+
+    bool operator()(const Todo& a, const Todo& b) const noexcept {
+        return operator()(a.name, b.name);
+    }
+};
+
+// A todo's place in the priority index: its key fields only, the rest is read from the name index
+struct TodoPriorityKey {
+    jh::pod::array<char, 64> name{};
+    uint64_t due_timestamp = 0;
+    uint8_t priority = 0;
+};
+
+// A todo's place under one of its tags (zero padded) in the tag index, likewise
+struct TodoTagKey {
+    jh::pod::array<char, 64> name{};
+    uint64_t due_timestamp = 0;
+    TodoTags tag{};
+    uint8_t priority = 0;
+
+    [[nodiscard]] std::string_view tag_view() const noexcept {
+        return {tag.data, strnlen(tag.data, TodoTags::size())};
+    }
+};
+
+static_assert(sizeof(TodoPriorityKey) == 80 && sizeof(TodoTagKey) == 96);
+
+// Orders by priority (highest first), then like TodoTimeLess; for todos and index keys alike
+struct TodoPriorityLess {
+    template<typename Entry>
+    bool operator()(const Entry& a, const Entry& b) const noexcept {
+        if (a.priority != b.priority) return a.priority > b.priority;
+        if (a.due_timestamp != b.due_timestamp) return a.due_timestamp < b.due_timestamp;
+        return std::memcmp(a.name.data, b.name.data, jh::pod::array<char, 64>::size()) < 0;
+    }
+};
+
+// Orders by tag (zero padded, so this is lexicographic), then like TodoPriorityLess
+struct TodoTagLess {
+    bool operator()(const TodoTagKey& a, const TodoTagKey& b) const noexcept {
+        if (const int c = std::memcmp(a.tag.data, b.tag.data, TodoTags::size())) return c < 0;
+        return TodoPriorityLess{}(a, b);
+    }
+};
+
+
+// "00".."99", two characters per entry
+inline constexpr auto iso_digit_pairs = [] {
+    std::array<char, 200> table{};
+    for (int i = 0; i < 100; ++i) {
+        table[2 * i] = static_cast<char>('0' + i / 10);
+        table[2 * i + 1] = static_cast<char>('0' + i % 10);
+    }
+    return table;
+}();
+
+// 10000-01-01T00:00:00Z; later dates are not four-digit years
+inline constexpr uint64_t iso_fast_limit = 253402300800ULL;
+
+inline constexpr std::size_t iso_timestamp_size = 20;
+
+// Writes "YYYY-MM-DDTHH:MM:SSZ" for timestamp < iso_fast_limit, without gmtime (thread safe).
+// Days to civil date follows H. Hinnant's civil_from_days.
+inline char* format_iso_timestamp(uint64_t timestamp, char* out) noexcept {
+    const uint64_t days = timestamp / 86400;
+    const uint64_t secs = timestamp % 86400;
+
+    const uint64_t z = days + 719468;
+    const uint64_t era = z / 146097;
+    const uint64_t doe = z - era * 146097;
+    const uint64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint64_t mp = (5 * doy + 2) / 153;
+    const uint64_t day = doy - (153 * mp + 2) / 5 + 1;
+    const uint64_t month = mp < 10 ? mp + 3 : mp - 9;
+    const uint64_t year = yoe + era * 400 + (month <= 2);
+
+    auto put2 = [&out](uint64_t v) {
+        std::memcpy(out, &iso_digit_pairs[2 * v], 2);
+        out += 2;
+    };
+    put2(year / 100);
+    put2(year % 100);
+    *out++ = '-';
+    put2(month);
+    *out++ = '-';
+    put2(day);
+    *out++ = 'T';
+    put2(secs / 3600);
+    *out++ = ':';
+    put2(secs / 60 % 60);
+    *out++ = ':';
+    put2(secs % 60);
+    *out++ = 'Z';
+    return out;
+}
+
+// Appends the ISO form of timestamp; years past 9999 take the strftime path
+template<typename String>
+void append_iso_timestamp(String& out, uint64_t timestamp) {
+    if (timestamp < iso_fast_limit) {
+        char buf[iso_timestamp_size];
+        out.append(buf, format_iso_timestamp(timestamp, buf));
+        return;
+    }
     auto t = static_cast<std::time_t>(timestamp);
-    std::tm* tm = std::gmtime(&t);
-    char buf[32];
-    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", tm);
-    return buf;
+    std::tm tm{};
+    char buf[64];
+    if (gmtime_r(&t, &tm) == nullptr) throw std::out_of_range("Timestamp out of range");
+    out.append(buf, std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm));
+}
+
+inline std::string timestamp_to_iso_string(uint64_t timestamp) {
+    std::string out;
+    append_iso_timestamp(out, timestamp);
+    return out;
 }
 
 
@@ -87,54 +273,128 @@ inline boost::json::object to_json(const Todo& todo) {
     obj["name"] = todo.name_view();
     if (todo.due_timestamp != UINT64_MAX)
         obj["due_date"] = timestamp_to_iso_string(todo.due_timestamp);
+    if (todo.priority)
+        obj["priority"] = static_cast<int64_t>(todo.priority);
+    if (todo.tags[0] != '\0') {
+        boost::json::array tags;
+        for_each_tag(todo.tags, [&](std::size_t offset, std::size_t size) {
+            tags.emplace_back(std::string_view(todo.tags.data + offset, size));
+        });
+        obj["tags"] = std::move(tags);
+    }
     return obj;
 }
 
-inline uint64_t parse_date_string_to_timestamp(const std::string& date_str) {
-    std::tm tm{};
-    std::istringstream ss(date_str);
-
-    if (date_str.size() == 10) {
-        ss >> std::get_time(&tm, "%Y-%m-%d");
-    } else if (date_str.size() >= 16) {
-        ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
-        if (ss.fail()) {
-            ss.clear();
-            ss.str(date_str);
-            ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M");
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+constexpr int64_t days_from_civil(int64_t year, unsigned month, unsigned day) noexcept {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const auto yoe = static_cast<unsigned>(year - era * 400);
+    const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+constexpr unsigned days_in_month(int64_t year, unsigned month) noexcept {
+    if (month == 2) return (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 29 : 28;
+    return (month == 4 || month == 6 || month == 9 || month == 11) ? 30 : 31;
+}
+
+// Parses `YYYY-MM-DD` or `YYYY-MM-DDTHH:MM[:SS[.fff]]`, optionally followed by `Z` or a `+HH:MM` / `-HH:MM`
+// offset (no suffix means UTC). Fractional seconds are dropped. Every field is range checked;
+// trailing input is an error.
+constexpr uint64_t parse_date_string_to_timestamp(std::string_view date_str) {
+    std::size_t pos = 0;
+    auto digits = [&](std::size_t count) -> unsigned {
+        if (date_str.size() - pos < count) throw std::invalid_argument("Invalid due_date format");
+        unsigned value = 0;
+        for (std::size_t end = pos + count; pos < end; ++pos) {
+            const char c = date_str[pos];
+            if (c < '0' || c > '9') throw std::invalid_argument("Invalid due_date format");
+            value = value * 10 + static_cast<unsigned>(c - '0');
         }
-    } else {
-        throw std::invalid_argument("Invalid due_date format");
-    }
+        return value;
+    };
+    auto expect = [&](char c) {
+        if (pos >= date_str.size() || date_str[pos] != c) throw std::invalid_argument("Invalid due_date format");
+        ++pos;
+    };
+    auto check = [](bool ok) {
+        if (!ok) throw std::invalid_argument("Failed to parse due_date");
+    };
 
-    if (ss.fail()) throw std::invalid_argument("Failed to parse due_date");
+    const unsigned year = digits(4);
+    expect('-');
+    const unsigned month = digits(2);
+    expect('-');
+    const unsigned day = digits(2);
+    check(month >= 1 && month <= 12 && day >= 1 && day <= days_in_month(year, month));
+
+    int64_t seconds = 0;
+    if (pos < date_str.size()) {
+        expect('T');
+        const unsigned hour = digits(2);
+        expect(':');
+        const unsigned minute = digits(2);
+        unsigned second = 0;
+        if (pos < date_str.size() && date_str[pos] == ':') {
+            ++pos;
+            second = digits(2);
+            if (pos < date_str.size() && date_str[pos] == '.') {
+                ++pos;
+                digits(1);
+                while (pos < date_str.size() && date_str[pos] >= '0' && date_str[pos] <= '9') ++pos;
+            }
+        }
+        check(hour <= 23 && minute <= 59 && second <= 59);
+        seconds = hour * 3600 + minute * 60 + second;
 
-    // UTC
-    return static_cast<uint64_t>(timegm(&tm));
+        if (pos < date_str.size() && date_str[pos] == 'Z') {
+            ++pos;
+        } else if (pos < date_str.size() && (date_str[pos] == '+' || date_str[pos] == '-')) {
+            const int sign = date_str[pos++] == '+' ? 1 : -1;
+            const unsigned off_hour = digits(2);
+            expect(':');
+            const unsigned off_minute = digits(2);
+            check(off_hour <= 23 && off_minute <= 59);
+            seconds -= sign * static_cast<int64_t>(off_hour * 3600 + off_minute * 60);
+        }
+        if (pos != date_str.size()) throw std::invalid_argument("Invalid due_date format");
+    }
+
+    const int64_t timestamp = days_from_civil(year, month, day) * 86400 + seconds;
+    check(timestamp >= 0);
+    return static_cast<uint64_t>(timestamp);
 }
 
+static_assert(parse_date_string_to_timestamp("2025-05-12") == 1747008000);
+static_assert(parse_date_string_to_timestamp("2025-05-12T18:00") == 1747072800);
+static_assert(parse_date_string_to_timestamp("2025-05-12T18:00:00Z") == 1747072800);
+static_assert(parse_date_string_to_timestamp("2025-05-12T18:00:00.123Z") == 1747072800);
+static_assert(parse_date_string_to_timestamp("2025-05-12T18:00:59.999999") == 1747072859);
+static_assert(parse_date_string_to_timestamp("2025-05-12T20:00:00.5+02:00") == 1747072800);
+
 
 inline Todo parse_todo_from_json(const boost::json::object& obj) {
     Todo todo;
 
-    // 1. name -> pod buffer
-    if (!obj.contains("name") || !obj.at("name").is_string())
+    // 1. name -> pod buffer, copied straight from the parsed value
+    const auto* name = obj.if_contains("name");
+    if (!name || !name->is_string())
         throw std::invalid_argument("Missing or invalid 'name'");
 
-    std::string name_str = std::string(obj.at("name").as_string());
+    const std::string_view name_str = name->get_string();
     if (name_str.size() >= jh::pod::array<char, 64>::size())
         throw std::invalid_argument("Todo name too long");
 
     std::memcpy(todo.name.data, name_str.data(), name_str.size());
 
     // 2. due_date: support int or string
-    if (obj.contains("due_date")) {
-        const auto& val = obj.at("due_date");
-
-        if (val.is_int64()) {
-            todo.due_timestamp = val.as_int64();
-        } else if (val.is_string()) {
-            todo.due_timestamp = parse_date_string_to_timestamp(val.as_string().c_str());
+    if (const auto* val = obj.if_contains("due_date")) {
+        if (val->is_int64()) {
+            todo.due_timestamp = val->get_int64();
+        } else if (val->is_string()) {
+            todo.due_timestamp = parse_date_string_to_timestamp(std::string_view(val->get_string()));
         } else {
             throw std::invalid_argument("Invalid 'due_date' type");
         }
@@ -142,5 +402,19 @@ inline Todo parse_todo_from_json(const boost::json::object& obj) {
         todo.due_timestamp = UINT64_MAX;
     }
 
+    // 3. optional priority (0..255) and tags (array of strings)
+    if (const auto* val = obj.if_contains("priority")) {
+        if (!val->is_int64() || val->get_int64() < 0 || val->get_int64() > 255)
+            throw std::invalid_argument("Invalid 'priority'");
+        todo.priority = static_cast<uint8_t>(val->get_int64());
+    }
+    if (const auto* val = obj.if_contains("tags")) {
+        if (!val->is_array()) throw std::invalid_argument("Invalid 'tags'");
+        for (const auto& tag : val->get_array()) {
+            if (!tag.is_string()) throw std::invalid_argument("Invalid 'tags'");
+            add_tag(todo.tags, std::string_view(tag.as_string()));
+        }
+    }
+
     return todo;
 }
@@ -5,89 +5,105 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <optional>
 #include <charconv>
-#include <memory_resource>
-#include <stdexcept>
 #include "../../Entity/Todo.hpp"
 #include "../InMemory/InMemoryTodoRepository.hpp"
+#include "CsvImporter.hpp"
 
 class CSVHandler {
 public:
-    // convert to CSV，including label
-    static void save(std::ostream &os) {
-        const InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
-        std::shared_lock lock(repo.mutex_);
-        os << "\"name\",\"due_date\"\n";
-        for (const auto &[name, ts]: repo.by_name_) {
-            std::size_t len = strnlen(name.data, jh::pod::array<char, 64>::size());
-            os << '"' << std::string_view(name.data, len) << "\"," << ts << '\n';
+    // Walks the store in bounded chunks, shard by shard in time order. Each chunk copies
+    // from the published time index under an epoch pin (no lock) and resumes after the
+    // last key it wrote, so writers are never blocked by an export.
+    class ExportCursor {
+    public:
+        // appends the next rows (the label first) to out; false once the store is exhausted
+        bool next(std::string &out) {
+            if (!header_done_) {
+                out += "\"name\",\"due_date\",\"priority\",\"tags\"\n";
+                header_done_ = true;
+            }
+            const InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
+            const std::size_t start = out.size();
+            while (shard_ < repo.shard_count() && out.size() - start < chunk_bytes) {
+                if (!copy_rows(repo.shards_[shard_])) {
+                    ++shard_;
+                    resume_.reset();
+                }
+                for (const Todo &todo: rows_) append_row(out, todo);
+            }
+            return shard_ < repo.shard_count();
         }
-    }
-
-    // from csv
-    static void load(std::istream& is, bool clear_before = true) {
-        InMemoryTodoRepository& repo = InMemoryTodoRepository::instance();
-        if (clear_before) repo.clear();
-        std::pmr::monotonic_buffer_resource pool;
-        std::pmr::vector<Todo> todos(&pool);
-
-        std::string line;
-        bool first_line = true;
 
-        while (std::getline(is, line)) {
-            if (line.empty()) continue;
-
-            std::string_view sv_line = line;
-
-            while (!sv_line.empty() && sv_line.front() == ' ') sv_line.remove_prefix(1);
-            while (!sv_line.empty() && sv_line.back() == ' ') sv_line.remove_suffix(1);
-
-            if (first_line) {
-                first_line = false;
-                if (is_label_line(sv_line)) continue;  // skip label
-            }
+    private:
+        static constexpr std::size_t chunk_rows = 1024;
+        static constexpr std::size_t chunk_bytes = std::size_t{64} << 10;
+
+        std::size_t shard_ = 0;
+        std::optional<Todo> resume_; // last row written from the current shard
+        std::vector<Todo> rows_;
+        bool header_done_ = false;
+
+        // copies up to chunk_rows after resume_; false when the shard has no more
+        template<typename Shard>
+        bool copy_rows(const Shard &shard) {
+            rows_.clear();
+            EpochGuard pin;
+            const auto view = shard.by_time.view();
+            auto it = resume_ ? view.upper_bound(*resume_) : view.begin();
+            for (; it != view.end() && rows_.size() < chunk_rows; ++it) rows_.push_back(*it);
+            if (rows_.empty()) return false;
+            resume_ = rows_.back();
+            return true;
+        }
 
-            todos.emplace_back(parse_csv_line(sv_line));
+        // "name",due,priority,"tags"; readers of the two-column format stop after due
+        static void append_row(std::string &out, const Todo &todo) {
+            char digits[24];
+            out += '"';
+            out += todo.name_view();
+            out += "\",";
+            out.append(digits, std::to_chars(digits, digits + sizeof(digits), todo.due_timestamp).ptr);
+            out += ',';
+            out.append(digits, std::to_chars(digits, digits + sizeof(digits), todo.priority).ptr);
+            out += ",\"";
+            out += todo.tags_view();
+            out += "\"\n";
         }
+    };
 
-        repo.batch_add(todos);
+    static ExportCursor export_cursor() {
+        return {};
     }
 
-private:
-    // is label
-    static bool is_label_line(std::string_view line) {
-        return line.starts_with("\"name") || line.starts_with("name");
+    // convert to CSV，including label
+    static void save(std::ostream &os) {
+        ExportCursor cursor;
+        std::string chunk;
+        for (bool more = true; more;) {
+            chunk.clear();
+            more = cursor.next(chunk);
+            os << chunk;
+        }
     }
 
-    // csv to t
-    static Todo parse_csv_line(std::string_view line) {
-        auto comma = line.find(',');
-        if (comma == std::string_view::npos)
-            throw std::invalid_argument("Invalid CSV format");
-
-        std::string_view name_part = line.substr(0, comma);
-        while (!name_part.empty() && name_part.front() == ' ') name_part.remove_prefix(1);
-        while (!name_part.empty() && name_part.back() == ' ') name_part.remove_suffix(1);
-
-        std::string_view ts_part = line.substr(comma + 1);
-        while (!ts_part.empty() && ts_part.front() == ' ') ts_part.remove_prefix(1);
-        while (!ts_part.empty() && ts_part.back() == ' ') ts_part.remove_suffix(1);
-
-
-        if (name_part.size() >= 2 && name_part.front() == '"' && name_part.back() == '"') {
-            name_part.remove_prefix(1);
-            name_part.remove_suffix(1);
+    // from csv, read in large blocks and parsed by CsvImporter; returns the rows read
+    static std::size_t load(std::istream& is, bool clear_before = true) {
+        CsvImporter importer(clear_before);
+        std::string block(read_block_size, '\0');
+        while (is) {
+            is.read(block.data(), static_cast<std::streamsize>(block.size()));
+            importer.feed(std::string_view(block.data(), static_cast<std::size_t>(is.gcount())));
         }
+        return importer.finish();
+    }
 
-        if (name_part.size() >= 64)
-            throw std::invalid_argument("Name too long in CSV");
-
-        Todo todo;
-        std::memcpy(todo.name.data, name_part.data(), name_part.size());
-
-        auto [ptr, ec] = std::from_chars(ts_part.data(), ts_part.data() + ts_part.size(), todo.due_timestamp);
-        if (ec != std::errc()) throw std::invalid_argument("Invalid due_timestamp");
-
-        return todo;
+    // from csv text already in memory, without copying it
+    static std::size_t load(std::string_view csv, bool clear_before = true) {
+        return CsvImporter::import(csv, clear_before);
     }
+
+private:
+    static constexpr std::size_t read_block_size = std::size_t{1} << 20;
 };
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include "../../Entity/Todo.hpp"
+#include "../InMemory/InMemoryTodoRepository.hpp"
+#include "CsvScanner.hpp"
+
+// Incremental CSV import: text is fed in arbitrary chunks and complete lines are parsed
+// (in parallel for large stages) into staged rows. The store is only touched by finish(),
+// once the whole text has parsed: a malformed line throws from feed()/finish() and leaves
+// the store as it was.
+class CsvImporter {
+public:
+    explicit CsvImporter(bool clear_before) : clear_before_(clear_before) {}
+
+    void feed(std::string_view chunk) {
+        if (carry_.empty() && chunk.size() >= stage_size) {
+            // large chunk: parse it in place and keep only the partial last line
+            chunk.remove_prefix(parse(chunk));
+            carry_.assign(chunk);
+            return;
+        }
+        carry_.append(chunk);
+        if (carry_.size() >= stage_size) {
+            carry_.erase(0, parse(carry_));
+        }
+    }
+
+    // Parses the unterminated last line, then clears the store (unless appending) and adds
+    // the staged rows in bounded batches; returns the number of rows read
+    std::size_t finish() {
+        carry_.push_back('\n');
+        parse(carry_);
+        carry_.clear();
+
+        InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
+        if (clear_before_) repo.clear();
+        for (std::size_t i = 0; i < rows_.size(); i += batch_rows) {
+            repo.batch_add(std::span<const Todo>(rows_).subspan(i, std::min(batch_rows, rows_.size() - i)));
+        }
+        return rows_.size();
+    }
+
+    // Imports a whole in-memory document
+    static std::size_t import(std::string_view csv, bool clear_before) {
+        CsvImporter importer(clear_before);
+        csv.remove_prefix(importer.parse(csv));
+        importer.carry_.assign(csv);
+        return importer.finish();
+    }
+
+private:
+    static constexpr std::size_t stage_size = std::size_t{4} << 20;      // bytes buffered before a parse
+    static constexpr std::size_t batch_rows = std::size_t{1} << 20;      // rows per batch_add
+    static constexpr std::size_t bytes_per_worker = std::size_t{1} << 20; // smallest slice worth a thread
+
+    bool clear_before_;
+    std::string carry_;
+    std::vector<Todo> rows_; // staged until finish()
+    bool header_pending_ = true;
+
+    // parses the complete lines of data, returns the bytes consumed
+    std::size_t parse(std::string_view data) {
+        std::size_t offset = 0;
+        while (header_pending_) {
+            const auto nl = data.find('\n', offset);
+            if (nl == std::string_view::npos) return offset;
+            const std::string_view line = trim(data.substr(offset, nl - offset));
+            offset = nl + 1;
+            if (line.empty()) continue;
+
+            header_pending_ = false;
+            if (!is_label_line(line)) rows_.push_back(parse_line(line, line.find(',')));
+        }
+
+        const std::string_view body = data.substr(offset);
+        const std::size_t workers = std::min<std::size_t>(
+                std::max(1u, std::thread::hardware_concurrency()), body.size() / bytes_per_worker);
+
+        const std::size_t consumed = workers <= 1 ? parse_lines(body, rows_) : parse_parallel(body, workers);
+        return offset + consumed;
+    }
+
+    // cuts body at newlines into `workers` slices and parses them concurrently, keeping row order
+    std::size_t parse_parallel(std::string_view body, std::size_t workers) {
+        std::vector<std::size_t> cuts{0};
+        for (std::size_t w = 1; w < workers; ++w) {
+            const auto nl = body.find('\n', std::max(cuts.back(), body.size() * w / workers));
+            if (nl == std::string_view::npos) break;
+            cuts.push_back(nl + 1);
+        }
+        cuts.push_back(body.size());
+
+        const std::size_t slices = cuts.size() - 1;
+        std::vector<std::vector<Todo>> parsed(slices);
+        std::vector<std::size_t> consumed(slices);
+        std::vector<std::exception_ptr> errors(slices);
+        std::vector<std::thread> threads;
+        threads.reserve(slices);
+        for (std::size_t s = 0; s < slices; ++s) {
+            threads.emplace_back([&, s] {
+                try {
+                    const std::string_view slice = body.substr(cuts[s], cuts[s + 1] - cuts[s]);
+                    parsed[s].reserve(slice.size() / 24);
+                    consumed[s] = parse_lines(slice, parsed[s]);
+                } catch (...) {
+                    errors[s] = std::current_exception();
+                }
+            });
+        }
+        for (auto &t: threads) t.join();
+
+        for (std::size_t s = 0; s < slices; ++s) {
+            if (errors[s]) std::rethrow_exception(errors[s]);
+            rows_.insert(rows_.end(), parsed[s].begin(), parsed[s].end());
+        }
+        return cuts[slices - 1] + consumed[slices - 1];
+    }
+
+    static std::size_t parse_lines(std::string_view data, std::vector<Todo> &out) {
+        return CsvScanner::for_each_line(data, [&](std::string_view line, std::size_t comma) {
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) return;
+            out.push_back(parse_line(line, comma));
+        });
+    }
+
+    static bool is_label_line(std::string_view line) {
+        return line.starts_with("\"name") || line.starts_with("name");
+    }
+
+    static std::string_view trim(std::string_view sv) {
+        while (!sv.empty() && (sv.front() == ' ')) sv.remove_prefix(1);
+        while (!sv.empty() && (sv.back() == ' ' || sv.back() == '\r')) sv.remove_suffix(1);
+        return sv;
+    }
+
+    static std::string_view unquote(std::string_view sv) {
+        if (sv.size() >= 2 && sv.front() == '"' && sv.back() == '"') {
+            sv.remove_prefix(1);
+            sv.remove_suffix(1);
+        }
+        return sv;
+    }
+
+    // line is `name,due_timestamp[,priority,tags]`, the name and the comma-separated tags optionally quoted
+    static Todo parse_line(std::string_view line, std::size_t comma) {
+        if (comma == std::string_view::npos) throw std::invalid_argument("Invalid CSV format");
+
+        const std::string_view name_part = unquote(trim(line.substr(0, comma)));
+        std::string_view rest = line.substr(comma + 1);
+        const auto ts_end = rest.find(',');
+        const std::string_view ts_part = trim(rest.substr(0, ts_end));
+        if (name_part.size() >= 64) throw std::invalid_argument("Name too long in CSV");
+
+        Todo todo;
+        std::memcpy(todo.name.data, name_part.data(), name_part.size());
+
+        auto [ptr, ec] = std::from_chars(ts_part.data(), ts_part.data() + ts_part.size(), todo.due_timestamp);
+        if (ec != std::errc()) throw std::invalid_argument("Invalid due_timestamp");
+        if (ts_end == std::string_view::npos) return todo;
+
+        rest.remove_prefix(ts_end + 1);
+        const auto priority_end = rest.find(',');
+        const std::string_view priority_part = trim(rest.substr(0, priority_end));
+        if (!priority_part.empty()) {
+            auto [p, e] = std::from_chars(priority_part.data(), priority_part.data() + priority_part.size(), todo.priority);
+            if (e != std::errc() || p != priority_part.data() + priority_part.size())
+                throw std::invalid_argument("Invalid priority");
+        }
+        if (priority_end == std::string_view::npos) return todo;
+
+        std::string_view tags = unquote(trim(rest.substr(priority_end + 1)));
+        while (!tags.empty()) {
+            const auto next = tags.find(',');
+            add_tag(todo.tags, trim(tags.substr(0, next)));
+            tags = next == std::string_view::npos ? std::string_view() : tags.substr(next + 1);
+        }
+        return todo;
+    }
+};
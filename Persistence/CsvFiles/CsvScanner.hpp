@@ -0,0 +1,98 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Splits CSV text into lines and finds the first comma of each, 64 bytes at a time.
+// Each block is classified into one bitmask of ',' and '\n' positions with SIMD compares,
+// so the parser jumps from separator to separator instead of testing every byte.
+class CsvScanner {
+public:
+    static constexpr std::size_t npos = std::string_view::npos;
+
+    // Calls on_line(line, comma) for every '\n'-terminated line of data, where comma is the
+    // offset of the first ',' in line (or npos). Returns the bytes consumed, up to and
+    // including the last '\n'; an unterminated tail is left for the caller.
+    template<typename OnLine>
+    static std::size_t for_each_line(std::string_view data, OnLine &&on_line) {
+        std::size_t line_start = 0;
+        std::size_t comma = npos;
+
+        auto visit = [&](std::uint64_t mask, std::size_t base) {
+            for (; mask; mask &= mask - 1) {
+                const std::size_t pos = base + static_cast<std::size_t>(std::countr_zero(mask));
+                if (data[pos] == ',') {
+                    if (comma == npos) comma = pos - line_start;
+                    continue;
+                }
+                on_line(data.substr(line_start, pos - line_start), comma);
+                line_start = pos + 1;
+                comma = npos;
+            }
+        };
+
+        std::size_t base = 0;
+        for (; base + block_size <= data.size(); base += block_size) {
+            visit(separators(data.data() + base), base);
+        }
+        if (base < data.size()) {
+            // zero padding never matches a separator
+            alignas(64) char tail[block_size] = {};
+            std::memcpy(tail, data.data() + base, data.size() - base);
+            visit(separators(tail), base);
+        }
+        return line_start;
+    }
+
+private:
+    static constexpr std::size_t block_size = 64;
+
+#if defined(__AVX2__)
+    static std::uint64_t separators(const char *p) noexcept {
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i newline = _mm256_set1_epi8('\n');
+        auto half = [&](const char *q) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q));
+            const __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, newline));
+            return static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(hit)));
+        };
+        return half(p) | half(p + 32) << 32;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    static std::uint64_t separators(const char *p) noexcept {
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i newline = _mm_set1_epi8('\n');
+        std::uint64_t mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+            const __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, newline));
+            mask |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm_movemask_epi8(hit))) << (16 * i);
+        }
+        return mask;
+    }
+#else
+    // portable SWAR: exact zero-byte test on x ^ pattern, then the 8 high bits packed into a byte
+    static std::uint64_t separators(const char *p) noexcept {
+        constexpr std::uint64_t lows = 0x7F7F7F7F7F7F7F7Full;
+        auto zero_bytes = [](std::uint64_t x) {
+            return ~(((x & lows) + lows) | x | lows);
+        };
+        std::uint64_t mask = 0;
+        for (int i = 0; i < 8; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, p + 8 * i, sizeof(word));
+            const std::uint64_t hit = zero_bytes(word ^ 0x2C2C2C2C2C2C2C2Cull) | zero_bytes(word ^ 0x0A0A0A0A0A0A0A0Aull);
+            mask |= ((hit >> 7) * 0x0102040810204080ull >> 56) << (8 * i);
+        }
+        return mask;
+    }
+#endif
+};
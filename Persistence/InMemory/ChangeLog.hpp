@@ -0,0 +1,151 @@
+#pragma once
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "../../Entity/Todo.hpp"
+
+// Bounded in-memory history of repository mutations for incremental sync.
+//
+// Every change gets the next sequence number and overwrites the oldest slot of a ring.
+// Changes to one name are recorded under that name's shard lock, so their sequence order
+// is their apply order. Sequence numbers start at the process start time in microseconds:
+// a position kept from an earlier run falls below the ring (and asks for a resync)
+// instead of being taken for one of this run.
+//
+// The ring is one lock shared by every shard, so it is opt-in: with capacity 0 nothing is
+// recorded and writers never touch it.
+class ChangeLog {
+public:
+    enum class Kind : std::uint8_t {
+        create,       // todo added
+        upsert,       // todo added or its due time replaced (imports, batch upserts)
+        erase,        // todo deleted
+        expire,       // todo removed by background expiry
+        erase_before, // every todo due at or before todo.due_timestamp removed
+        clear,        // everything removed
+        resync        // a bulk change too large to record row by row
+    };
+
+    struct Change {
+        std::uint64_t seq = 0;
+        Kind kind = Kind::create;
+        Todo todo{}; // the todo (erase / expire: as it was), or the cut of erase_before
+    };
+
+    enum class ReadStatus { ok, resync };
+
+    explicit ChangeLog(std::size_t capacity)
+            : ring_(capacity ? std::bit_ceil(std::max<std::size_t>(capacity, 16)) : 0),
+              first_(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::system_clock::now().time_since_epoch()).count())),
+              head_(first_ - 1) {}
+
+    // Record under the lock that orders the change
+    void record(Kind kind, const Todo &todo) {
+        if (!enabled()) return;
+        std::vector<std::pair<std::uint64_t, std::function<void()>>> waiters;
+        {
+            std::lock_guard lock(mutex_);
+            const std::uint64_t seq = ++head_;
+            ring_[seq & (ring_.size() - 1)] = {seq, kind, todo};
+            waiters.swap(waiters_);
+        }
+        for (auto &[id, notify]: waiters) notify();
+    }
+
+    void record(Kind kind) {
+        record(kind, Todo{});
+    }
+
+    // one change per todo of [first, last), under one acquisition of the ring
+    template<typename It>
+    void record_all(Kind kind, It first, It last) {
+        if (!enabled()) return;
+        std::vector<std::pair<std::uint64_t, std::function<void()>>> waiters;
+        {
+            std::lock_guard lock(mutex_);
+            for (; first != last; ++first) {
+                const std::uint64_t seq = ++head_;
+                ring_[seq & (ring_.size() - 1)] = {seq, kind, *first};
+            }
+            waiters.swap(waiters_);
+        }
+        for (auto &[id, notify]: waiters) notify();
+    }
+
+    std::size_t capacity() const noexcept {
+        return ring_.size();
+    }
+
+    // false when configured with capacity 0: read and subscribe must not be called then
+    bool enabled() const noexcept {
+        return !ring_.empty();
+    }
+
+    // sequence number of the latest change
+    std::uint64_t head() const {
+        std::lock_guard lock(mutex_);
+        return head_;
+    }
+
+    // Appends up to limit changes after `since` to out and sets next to the last one read
+    // (or since). resync: since is no position of this log, or changes after it were dropped
+    // from the ring or recorded as one bulk resync; next is then the head to continue from.
+    ReadStatus read(std::uint64_t since, std::size_t limit, std::vector<Change> &out, std::uint64_t &next) const {
+        std::lock_guard lock(mutex_);
+        const std::uint64_t oldest = head_ - first_ + 1 > ring_.size() ? head_ - ring_.size() + 1 : first_;
+        if (since > head_ || since + 1 < oldest) {
+            next = head_;
+            return ReadStatus::resync;
+        }
+
+        const std::size_t start = out.size();
+        for (std::uint64_t seq = since + 1; seq <= head_ && out.size() - start < limit; ++seq) {
+            const Change &change = ring_[seq & (ring_.size() - 1)];
+            if (change.kind == Kind::resync) {
+                out.resize(start);
+                next = head_;
+                return ReadStatus::resync;
+            }
+            out.push_back(change);
+        }
+        next = out.size() > start ? out.back().seq : since;
+        return ReadStatus::ok;
+    }
+
+    // Calls notify once, from the recording thread, after a change beyond since was recorded
+    // (at once when there is one already). notify must not block: it runs under shard locks.
+    // Returns an id for unsubscribe, 0 when notify already ran.
+    std::uint64_t subscribe(std::uint64_t since, std::function<void()> notify) {
+        {
+            std::lock_guard lock(mutex_);
+            if (head_ <= since) {
+                waiters_.emplace_back(++last_waiter_, std::move(notify));
+                return last_waiter_;
+            }
+        }
+        notify();
+        return 0;
+    }
+
+    // drops a notification that is no longer wanted (a poll that timed out)
+    void unsubscribe(std::uint64_t id) {
+        std::lock_guard lock(mutex_);
+        std::erase_if(waiters_, [id](const auto &waiter) { return waiter.first == id; });
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<Change> ring_;
+    std::uint64_t first_; // sequence number of the first change
+    std::uint64_t head_;
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> waiters_;
+    std::uint64_t last_waiter_ = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+// Epoch-based reclamation for structures published RCU-style.
+//
+// A reader pins the current global epoch in its thread's slot (EpochGuard) before it loads
+// a published pointer, and clears it when done. A writer that unpublishes memory tags it
+// with the epoch at that moment (Epoch::current()) and frees it once every pinned slot is
+// newer than the tag (Epoch::safe_before()), i.e. no reader can still be looking at it.
+class Epoch {
+public:
+    static std::uint64_t current() noexcept {
+        return global().load(std::memory_order_seq_cst);
+    }
+
+    // Advances the epoch and returns the oldest epoch still pinned; memory retired
+    // at an epoch strictly below it is unreachable
+    static std::uint64_t safe_before() noexcept {
+        std::uint64_t oldest = global().fetch_add(1, std::memory_order_seq_cst) + 1;
+        const std::size_t used = high_water().load(std::memory_order_seq_cst);
+        for (std::size_t i = 0; i < used; ++i) {
+            const std::uint64_t pinned = slots()[i].epoch.load(std::memory_order_seq_cst);
+            if (pinned != 0) oldest = std::min(oldest, pinned);
+        }
+        return oldest;
+    }
+
+private:
+    friend class EpochGuard;
+
+    static constexpr std::size_t max_threads = 512;
+
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{0}; // 0 = not reading
+        std::atomic<bool> claimed{false};
+    };
+
+    // one slot per thread, claimed on first use and released when the thread exits
+    struct ThreadSlot {
+        Slot *slot = nullptr;
+        std::size_t depth = 0;
+
+        ThreadSlot() {
+            for (std::size_t i = 0; i < max_threads; ++i) {
+                bool expected = false;
+                if (slots()[i].claimed.compare_exchange_strong(expected, true)) {
+                    slot = &slots()[i];
+                    std::size_t used = high_water().load();
+                    while (used < i + 1 && !high_water().compare_exchange_weak(used, i + 1)) {}
+                    return;
+                }
+            }
+            throw std::runtime_error("Epoch: too many reader threads");
+        }
+
+        ~ThreadSlot() {
+            slot->epoch.store(0);
+            slot->claimed.store(false);
+        }
+    };
+
+    static std::atomic<std::uint64_t> &global() noexcept {
+        static std::atomic<std::uint64_t> epoch{1};
+        return epoch;
+    }
+
+    static Slot *slots() noexcept {
+        static Slot table[max_threads];
+        return table;
+    }
+
+    static std::atomic<std::size_t> &high_water() noexcept {
+        static std::atomic<std::size_t> used{0};
+        return used;
+    }
+
+    static ThreadSlot &thread_slot() {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+};
+
+// Pins the calling thread's epoch for its lifetime; nested guards share the outer pin
+class EpochGuard {
+public:
+    EpochGuard() : slot_(Epoch::thread_slot()) {
+        if (slot_.depth++ == 0) {
+            slot_.slot->epoch.store(Epoch::current(), std::memory_order_seq_cst);
+        }
+    }
+
+    ~EpochGuard() {
+        if (--slot_.depth == 0) slot_.slot->epoch.store(0, std::memory_order_release);
+    }
+
+    EpochGuard(const EpochGuard &) = delete;
+
+    EpochGuard &operator=(const EpochGuard &) = delete;
+
+private:
+    Epoch::ThreadSlot &slot_;
+};
+
+// Unpublished memory of one writer (callers serialize access, e.g. under a shard lock)
+class RetireList {
+public:
+    RetireList() = default;
+
+    RetireList(const RetireList &) = delete;
+
+    RetireList &operator=(const RetireList &) = delete;
+
+    ~RetireList() {
+        for (const auto &item: items_) item.free(item.ptr);
+    }
+
+    template<typename P>
+    void retire(P *ptr) {
+        items_.push_back({Epoch::current(), ptr, [](void *p) { delete static_cast<P *>(p); }});
+        if (items_.size() >= collect_threshold_) collect();
+    }
+
+    // frees everything no reader can reach any more
+    void collect() {
+        const std::uint64_t safe = Epoch::safe_before();
+        auto kept = std::partition(items_.begin(), items_.end(), [safe](const Item &item) { return item.epoch >= safe; });
+        for (auto it = kept; it != items_.end(); ++it) it->free(it->ptr);
+        items_.erase(kept, items_.end());
+        // a long reader keeps items alive; back off so each retire stays amortized O(1)
+        collect_threshold_ = std::max<std::size_t>(min_threshold, items_.size() * 2);
+    }
+
+private:
+    static constexpr std::size_t min_threshold = 64;
+
+    struct Item {
+        std::uint64_t epoch;
+        void *ptr;
+        void (*free)(void *);
+    };
+
+    std::vector<Item> items_;
+    std::size_t collect_threshold_ = min_threshold;
+};
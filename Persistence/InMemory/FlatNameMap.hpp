@@ -0,0 +1,355 @@
+#pragma once
+
+#include <jh/pod>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../../Entity/Todo.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash map from 64-byte todo names to Value (Swiss-table layout).
+// One control byte per slot holds 7 bits of the hash; a probe loads a whole group of
+// control bytes and matches them in one SIMD compare, touching entries only on a tag hit.
+// Entries keep the name inline with its length and a 32-bit hash, so a miss never
+// calls strnlen and a rehash never rehashes names.
+template<typename Value>
+class FlatNameMap {
+public:
+    using name_type = jh::pod::array<char, 64>;
+
+    struct Entry {
+        name_type key;
+        Value value;
+        std::uint32_t hash;
+        std::uint8_t length;
+
+        [[nodiscard]] std::string_view key_view() const noexcept {
+            return {key.data, length};
+        }
+    };
+
+private:
+    static constexpr std::int8_t empty_tag = -128;  // 0b10000000
+    static constexpr std::int8_t deleted_tag = -2;  // 0b11111110
+
+    // bitmask of matching slots in a group; SWAR masks keep one bit per byte (shift 3)
+    struct BitMask {
+        std::uint64_t bits;
+        int shift;
+
+        explicit operator bool() const noexcept { return bits != 0; }
+
+        std::size_t lowest() const noexcept {
+            return static_cast<std::size_t>(std::countr_zero(bits)) >> shift;
+        }
+
+        void clear_lowest() noexcept { bits &= bits - 1; }
+    };
+
+#if defined(__AVX2__)
+    struct Group {
+        static constexpr std::size_t width = 32;
+        __m256i ctrl;
+
+        explicit Group(const std::int8_t *p) noexcept
+                : ctrl(_mm256_load_si256(reinterpret_cast<const __m256i *>(p))) {}
+
+        BitMask match(std::int8_t tag) const noexcept {
+            auto m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(tag), ctrl));
+            return {static_cast<std::uint32_t>(m), 0};
+        }
+
+        BitMask match_empty() const noexcept { return match(empty_tag); }
+
+        BitMask match_free() const noexcept { // empty or deleted: the only negative tags
+            return {static_cast<std::uint32_t>(_mm256_movemask_epi8(ctrl)), 0};
+        }
+    };
+#elif defined(__SSE2__) || defined(_M_X64)
+    struct Group {
+        static constexpr std::size_t width = 16;
+        __m128i ctrl;
+
+        explicit Group(const std::int8_t *p) noexcept
+                : ctrl(_mm_load_si128(reinterpret_cast<const __m128i *>(p))) {}
+
+        BitMask match(std::int8_t tag) const noexcept {
+            auto m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl));
+            return {static_cast<std::uint32_t>(m), 0};
+        }
+
+        BitMask match_empty() const noexcept { return match(empty_tag); }
+
+        BitMask match_free() const noexcept {
+            return {static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl)), 0};
+        }
+    };
+#else
+    // portable 8-byte SWAR group (arm64 and others)
+    struct Group {
+        static constexpr std::size_t width = 8;
+        static constexpr std::uint64_t lsbs = 0x0101010101010101ull;
+        static constexpr std::uint64_t msbs = 0x8080808080808080ull;
+        std::uint64_t ctrl;
+
+        explicit Group(const std::int8_t *p) noexcept { std::memcpy(&ctrl, p, sizeof(ctrl)); }
+
+        // may report a false positive next to a true one; callers compare keys anyway
+        BitMask match(std::int8_t tag) const noexcept {
+            const std::uint64_t x = ctrl ^ (lsbs * static_cast<std::uint8_t>(tag));
+            return {(x - lsbs) & ~x & msbs, 3};
+        }
+
+        BitMask match_empty() const noexcept { return {ctrl & ~(ctrl << 6) & msbs, 3}; }
+
+        BitMask match_free() const noexcept { return {ctrl & msbs, 3}; }
+    };
+#endif
+
+    static constexpr std::size_t group_width = Group::width;
+
+    struct alignas(group_width) ControlGroup {
+        std::int8_t tags[group_width];
+    };
+
+public:
+    class iterator {
+    public:
+        iterator(FlatNameMap *map, std::size_t slot) : map_(map), slot_(slot) { skip(); }
+
+        Entry &operator*() const { return map_->entries_[slot_]; }
+
+        Entry *operator->() const { return &map_->entries_[slot_]; }
+
+        iterator &operator++() {
+            ++slot_;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const { return slot_ == other.slot_; }
+
+    private:
+        FlatNameMap *map_;
+        std::size_t slot_;
+
+        void skip() {
+            while (slot_ < map_->capacity() && map_->tag(slot_) < 0) ++slot_;
+        }
+    };
+
+    class const_iterator {
+    public:
+        const_iterator(const FlatNameMap *map, std::size_t slot) : map_(map), slot_(slot) { skip(); }
+
+        const Entry &operator*() const { return map_->entries_[slot_]; }
+
+        const Entry *operator->() const { return &map_->entries_[slot_]; }
+
+        const_iterator &operator++() {
+            ++slot_;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const { return slot_ == other.slot_; }
+
+    private:
+        const FlatNameMap *map_;
+        std::size_t slot_;
+
+        void skip() {
+            while (slot_ < map_->capacity() && map_->tag(slot_) < 0) ++slot_;
+        }
+    };
+
+    FlatNameMap() { allocate(1); }
+
+    iterator begin() { return {this, 0}; }
+
+    iterator end() { return {this, capacity()}; }
+
+    const_iterator begin() const { return {this, 0}; }
+
+    const_iterator end() const { return {this, capacity()}; }
+
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    [[nodiscard]] std::size_t capacity() const noexcept { return entries_.size(); }
+
+    void clear() {
+        allocate(1);
+        size_ = 0;
+    }
+
+    // room for count entries in total (not count more), as std::unordered_map::reserve
+    void reserve(std::size_t count) {
+        if (count + tombstones_ > max_load(capacity())) rehash(count);
+    }
+
+    Entry *find(std::string_view name) noexcept {
+        return const_cast<Entry *>(std::as_const(*this).find(name));
+    }
+
+    const Entry *find(std::string_view name) const noexcept {
+        name = normalize(name);
+        const std::uint32_t h = hash_of(name);
+        const std::size_t slot = lookup(name, h);
+        return slot == npos ? nullptr : &entries_[slot];
+    }
+
+    const Entry *find(const name_type &name) const noexcept {
+        return find(std::string_view(name.data, name_type::size()));
+    }
+
+    Entry *find(const name_type &name) noexcept {
+        return find(std::string_view(name.data, name_type::size()));
+    }
+
+    bool contains(std::string_view name) const noexcept { return find(name) != nullptr; }
+
+    bool contains(const name_type &name) const noexcept { return find(name) != nullptr; }
+
+    // inserts {name, value} unless the name is present; returns the entry and whether it was inserted
+    std::pair<Entry *, bool> try_emplace(const name_type &name, const Value &value) {
+        const std::string_view key = normalize(std::string_view(name.data, name_type::size()));
+        const std::uint32_t h = hash_of(key);
+        if (std::size_t slot = lookup(key, h); slot != npos) return {&entries_[slot], false};
+
+        if (size_ + tombstones_ + 1 > max_load(capacity())) rehash(size_ + 1);
+
+        const std::size_t slot = free_slot(h);
+        if (tag(slot) == deleted_tag) --tombstones_;
+        set_tag(slot, static_cast<std::int8_t>(h & 0x7F));
+
+        Entry &entry = entries_[slot];
+        entry.key = {}; // the name itself, zero padded, whatever followed its terminator
+        std::memcpy(entry.key.data, key.data(), key.size());
+        entry.value = value;
+        entry.hash = h;
+        entry.length = static_cast<std::uint8_t>(key.size());
+        ++size_;
+        return {&entry, true};
+    }
+
+    bool erase(std::string_view name) noexcept {
+        Entry *entry = find(name);
+        if (!entry) return false;
+        erase(entry);
+        return true;
+    }
+
+    bool erase(const name_type &name) noexcept {
+        return erase(std::string_view(name.data, name_type::size()));
+    }
+
+    void erase(Entry *entry) noexcept {
+        const auto slot = static_cast<std::size_t>(entry - entries_.data());
+        const std::size_t group = slot / group_width;
+        // a group that still has an empty tag never stopped a probe, so the slot can become empty again
+        if (Group(controls_[group].tags).match_empty()) {
+            set_tag(slot, empty_tag);
+        } else {
+            set_tag(slot, deleted_tag);
+            ++tombstones_;
+        }
+        --size_;
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::vector<ControlGroup> controls_;
+    std::vector<Entry> entries_;
+    std::size_t size_ = 0;
+    std::size_t tombstones_ = 0;
+
+    // 7/8 maximum load
+    static std::size_t max_load(std::size_t capacity) noexcept {
+        return capacity - capacity / 8;
+    }
+
+    // keys compare up to the first NUL, as TodoNameEqual does
+    static std::string_view normalize(std::string_view name) noexcept {
+        return {name.data(), strnlen(name.data(), name.size())};
+    }
+
+    static std::uint32_t hash_of(std::string_view normalized) noexcept {
+        const std::uint64_t h = jh::pod::bytes_view::from(normalized.data(), normalized.size()).hash();
+        return static_cast<std::uint32_t>(h ^ (h >> 32));
+    }
+
+    std::int8_t tag(std::size_t slot) const noexcept {
+        return controls_[slot / group_width].tags[slot % group_width];
+    }
+
+    void set_tag(std::size_t slot, std::int8_t value) noexcept {
+        controls_[slot / group_width].tags[slot % group_width] = value;
+    }
+
+    std::size_t group_mask() const noexcept { return controls_.size() - 1; }
+
+    // triangular probing over groups visits every group once for power-of-two counts
+    std::size_t lookup(std::string_view key, std::uint32_t h) const noexcept {
+        const auto tag7 = static_cast<std::int8_t>(h & 0x7F);
+        std::size_t group = (h >> 7) & group_mask();
+        for (std::size_t step = 1;; ++step) {
+            const Group g(controls_[group].tags);
+            for (BitMask m = g.match(tag7); m; m.clear_lowest()) {
+                const std::size_t slot = group * group_width + m.lowest();
+                const Entry &e = entries_[slot];
+                if (e.hash == h && e.length == key.size() && std::memcmp(e.key.data, key.data(), key.size()) == 0) {
+                    return slot;
+                }
+            }
+            if (g.match_empty() || step > controls_.size()) return npos;
+            group = (group + step) & group_mask();
+        }
+    }
+
+    std::size_t free_slot(std::uint32_t h) const noexcept {
+        std::size_t group = (h >> 7) & group_mask();
+        for (std::size_t step = 1;; ++step) {
+            if (BitMask m = Group(controls_[group].tags).match_free()) {
+                return group * group_width + m.lowest();
+            }
+            group = (group + step) & group_mask();
+        }
+    }
+
+    void allocate(std::size_t groups) {
+        ControlGroup empty_group{};
+        std::memset(empty_group.tags, static_cast<unsigned char>(empty_tag), group_width);
+        controls_.assign(groups, empty_group);
+        entries_.assign(groups * group_width, Entry{});
+        tombstones_ = 0;
+    }
+
+    void rehash(std::size_t min_size) {
+        std::size_t groups = 1;
+        while (max_load(groups * group_width) < min_size) groups *= 2;
+        if (groups < controls_.size()) groups = controls_.size(); // never shrink on insert
+
+        std::vector<ControlGroup> old_controls = std::move(controls_);
+        std::vector<Entry> old_entries = std::move(entries_);
+        allocate(groups);
+
+        for (std::size_t slot = 0; slot < old_entries.size(); ++slot) {
+            if (old_controls[slot / group_width].tags[slot % group_width] < 0) continue;
+            const Entry &e = old_entries[slot];
+            const std::size_t target = free_slot(e.hash);
+            set_tag(target, static_cast<std::int8_t>(e.hash & 0x7F));
+            entries_[target] = e;
+        }
+    }
+};
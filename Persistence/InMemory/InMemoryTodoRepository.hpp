@@ -1,29 +1,76 @@
 #pragma once
 
-#include <unordered_map>
-#include <map>
 #include <shared_mutex>
+#include <mutex>
 #include <optional>
 #include <vector>
+#include <memory>
 #include <memory_resource>
 #include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <ranges>
+#include <thread>
+#include <bit>
+#include <exception>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
 #include "../../Entity/Todo.hpp"
+#include "SortedBlockIndex.hpp"
+#include "FlatNameMap.hpp"
+#include "ChangeLog.hpp"
+#include "NameSearch.hpp"
+#include "../WalFiles/WriteAheadLog.hpp"
 
 class CSVHandler;
+class SnapshotHandler;
 
 class InMemoryTodoRepository {
 public:
     static InMemoryTodoRepository &instance() {
-        static InMemoryTodoRepository repo;
+        static InMemoryTodoRepository repo(shard_setting());
         return repo;
     }
 
+    // Number of lock stripes (rounded up to a power of two).
+    // Only effective before the first instance() call.
+    static void configure(std::size_t shard_count) {
+        shard_setting() = shard_count;
+    }
+
+    // Changes kept for /todo_changes (rounded up to a power of two, 0 = no change feed); same timing as configure
+    static void configure_change_log(std::size_t capacity) {
+        change_log_setting() = capacity;
+    }
+
+    // Mutations are appended to the journal under the lock that orders them and
+    // committed after the lock is released. Once it has failed, writes throw JournalFailed
+    // with nothing applied. Attach after replay, before serving.
+    void attach_journal(WriteAheadLog *journal) noexcept {
+        journal_ = journal;
+    }
+
     bool add(const Todo &todo) {
-        std::unique_lock lock(mutex_);
-        if (by_name_.contains(todo.name)) return false;
+        std::uint64_t lsn = 0;
+        {
+            Shard &shard = shard_for(todo.name);
+            auto lock = lock_shard(shard);
+            check_journal();
+            const auto [entry, inserted] = shard.by_name.try_emplace(todo.name, todo.details());
+            if (!inserted) return false;
 
-        by_name_.emplace(todo.name, todo.due_timestamp);
-        by_time_.emplace(todo.due_timestamp, todo.name);
+            const Todo stored = Todo::make(entry->key, entry->value);
+            auto publish = shard.batch();
+            shard.by_time.insert(stored);
+            index(shard, stored);
+            changes_.record(ChangeLog::Kind::create, stored);
+            if (journal_) lsn = journal_->append_add(stored);
+        }
+        changed();
+        commit(lsn);
         return true;
     }
 
@@ -36,111 +83,823 @@ public:
     }
     )
     void batch_add(const Container &todos) {
-        std::unique_lock lock(mutex_);
-
         std::pmr::monotonic_buffer_resource pool;
-        std::pmr::vector<std::pair<jh::pod::array<char, 64>, uint64_t>> name_index{&pool};
-        std::pmr::vector<std::pair<uint64_t, jh::pod::array<char, 64>>> time_index{&pool};
-
-        name_index.reserve(todos.size());
-        time_index.reserve(todos.size());
 
+        // bucket by shard first, so every shard is locked exactly once
+        std::pmr::vector<std::pmr::vector<const Todo *>> buckets{shard_count(), &pool};
         for (const auto &todo: todos) {
-            auto it = by_name_.find(todo.name);
-
-            if (it != by_name_.end()) {
-                if (it->second != todo.due_timestamp) {
-                    by_time_.erase(it->second);
-                    it->second = todo.due_timestamp;
-                    by_time_.emplace(todo.due_timestamp, todo.name);
-                }
-            } else {
-                name_index.emplace_back(todo.name, todo.due_timestamp);
-                time_index.emplace_back(todo.due_timestamp, todo.name);
-            }
+            buckets[shard_index(todo.name)].push_back(&todo);
         }
 
-        by_name_.insert(
-                std::make_move_iterator(name_index.begin()),
-                std::make_move_iterator(name_index.end())
-        );
+        // large batches fill their shards in parallel; shards never share a bucket
+        const std::size_t workers = std::min(shard_count(), todos.size() / parallel_batch_rows + 1);
+        const bool log_rows = changes_.enabled() && todos.size() <= changes_.capacity(); // a bigger one would only flush the ring
+        std::vector<std::uint64_t> lsns(workers, 0);
+        for_each_shard(workers, [&](std::size_t worker, std::size_t i) {
+            if (!buckets[i].empty()) lsns[worker] = std::max(lsns[worker], add_bucket(shards_[i], buckets[i], log_rows));
+        });
+        if (!log_rows) changes_.record(ChangeLog::Kind::resync);
+        if (todos.size()) changed();
+        commit(*std::max_element(lsns.begin(), lsns.end()));
+    }
+
+    struct Operation {
+        enum class Kind : std::uint8_t { create, get, erase, upsert };
+        Kind kind;
+        Todo todo; // the name; the due time for create / upsert
+    };
+
+    struct OperationResult {
+        enum class Status : std::uint8_t { created, exists, found, not_found, deleted, updated };
+        Status status;
+        TodoDetails details{}; // found: the stored due time and metadata
+    };
 
-        by_time_.insert(
-                std::make_move_iterator(time_index.begin()),
-                std::make_move_iterator(time_index.end())
-        );
+    // Runs a mixed batch with one lock acquisition per touched shard (shared when the shard
+    // only sees gets). Operations on one name apply in the given order; results[i] answers ops[i].
+    std::vector<OperationResult> apply(const std::vector<Operation> &ops) {
+        std::pmr::monotonic_buffer_resource pool;
+        std::pmr::vector<std::pmr::vector<std::size_t>> buckets{shard_count(), &pool};
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            buckets[shard_index(ops[i].todo.name)].push_back(i);
+        }
+
+        std::vector<OperationResult> results(ops.size());
+        const std::size_t workers = std::min(shard_count(), ops.size() / parallel_batch_rows + 1);
+        std::vector<std::uint64_t> lsns(workers, 0);
+        for_each_shard(workers, [&](std::size_t worker, std::size_t i) {
+            if (!buckets[i].empty()) lsns[worker] = std::max(lsns[worker], apply_bucket(shards_[i], buckets[i], ops, results));
+        });
+        if (std::any_of(ops.begin(), ops.end(), [](const Operation &op) { return op.kind != Operation::Kind::get; })) changed();
+        commit(*std::max_element(lsns.begin(), lsns.end()));
+        return results;
     }
 
     bool exists(std::string_view name) const {
-        std::shared_lock lock(mutex_);
-        return by_name_.contains(name);
+        const Shard &shard = shard_for(name);
+        auto lock = share_shard(shard);
+        return shard.by_name.contains(name);
     }
 
     std::optional<Todo> get(std::string_view name) const {
-        std::shared_lock lock(mutex_);
-        auto it = by_name_.find(name);
-        if (it == by_name_.end()) return std::nullopt;
-        return Todo{it->first, it->second};
+        const Shard &shard = shard_for(name);
+        auto lock = share_shard(shard);
+        const auto *entry = shard.by_name.find(name);
+        if (!entry) return std::nullopt;
+        return Todo::make(entry->key, entry->value);
     }
 
+    // Lock-free: scans the published version of every shard's time index under an
+    // epoch pin, so a long scan never delays writers
     std::vector<Todo> range_before(uint64_t timestamp) const {
-        std::shared_lock lock(mutex_);
         std::vector<Todo> result;
+        std::vector<std::size_t> runs{0};
+        runs.reserve(shard_count() + 1);
 
-        auto end_it = by_time_.upper_bound(timestamp);
-        result.reserve(std::distance(by_time_.begin(), end_it));
-
-        std::transform(by_time_.begin(), end_it, std::back_inserter(result),
-                       [](const auto &pair) {
-                           return Todo{pair.second, pair.first};
-                       });
+        // every shard yields one run sorted by time
+        {
+            EpochGuard pin;
+            for (std::size_t i = 0; i < shard_count(); ++i) {
+                const auto view = shards_[i].by_time.view();
+                result.insert(result.end(), view.begin(), view.upper_bound(time_probe(timestamp)));
+                runs.push_back(result.size());
+            }
+        }
 
+        merge_runs(result, runs);
         return result;
     }
 
+    struct Page {
+        std::vector<Todo> todos;
+        bool more = false; // todos remain in the range after the last one returned
+    };
+
+    // Up to `limit` todos with from <= due_timestamp < to (to == UINT64_MAX: no upper bound)
+    // in (timestamp, name) order, starting strictly after the keyset cursor `after` when given. Lock-free like
+    // range_before, but it merges the shards lazily and stops after `limit` rows.
+    Page range_page(uint64_t from, uint64_t to, std::size_t limit, const std::optional<Todo> &after = std::nullopt) const {
+        using Iterator = decltype(shards_[0].by_time.view().begin());
+        struct Run {
+            Iterator it, end;
+        };
+        const TodoTimeLess by_time{};
+        // min-heap on the head of every shard's run
+        auto later = [&](const Run &a, const Run &b) { return by_time(*b.it, *a.it); };
+        auto in_range = [to](const Iterator &it, const Iterator &end) {
+            return it != end && (it->due_timestamp < to || to == UINT64_MAX);
+        };
+
+        Page page;
+        EpochGuard pin;
+        std::vector<Run> heap;
+        heap.reserve(shard_count());
+
+        Todo start{};
+        start.due_timestamp = from;
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            const auto view = shards_[i].by_time.view();
+            auto it = after && !by_time(*after, start) ? view.upper_bound(*after) : view.lower_bound(start);
+            if (in_range(it, view.end())) heap.push_back({it, view.end()});
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        page.todos.reserve(std::min(limit, std::size_t{4096}));
+        while (!heap.empty()) {
+            if (page.todos.size() == limit) {
+                page.more = true;
+                break;
+            }
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Run &run = heap.back();
+            page.todos.push_back(*run.it);
+            if (in_range(++run.it, run.end)) {
+                std::push_heap(heap.begin(), heap.end(), later);
+            } else {
+                heap.pop_back();
+            }
+        }
+        return page;
+    }
+
+    // Up to `limit` todos whose name starts with prefix and, when given, contains needle, in name
+    // order, starting strictly after the cursor `after` when given. The names are merged lock-free
+    // like range_page, over the shards' name indexes: each run seeks to the prefix and ends where
+    // the prefix does. The rest of each todo is then read from by_name, under one shared lock per
+    // shard; a todo erased in between is skipped and the merge fills its place.
+    Page search(std::string_view prefix, std::optional<std::string_view> needle, std::size_t limit,
+                const std::optional<Todo> &after = std::nullopt) const {
+        using Name = jh::pod::array<char, 64>;
+        if (prefix.size() > Name::size() || prefix.find('\0') != std::string_view::npos) {
+            throw std::invalid_argument("Invalid prefix");
+        }
+        using Iterator = decltype(shards_[0].by_name_order.view().begin());
+        struct Run {
+            Iterator it, end;
+            std::size_t shard;
+        };
+        const TodoNameLess by_name{};
+        auto later = [&](const Run &a, const Run &b) { return by_name(*b.it, *a.it); };
+
+        std::optional<SubstringMatcher> contains;
+        if (needle) contains.emplace(*needle);
+        // advances to the run's next match; false once past the prefix
+        auto seek = [&](Run &run) {
+            for (; run.it != run.end && has_prefix(*run.it, prefix); ++run.it) {
+                if (!contains || (*contains)(*run.it)) return true;
+            }
+            return false;
+        };
+
+        Page page;
+        EpochGuard pin;
+        std::vector<Run> heap;
+        heap.reserve(shard_count());
+
+        Name start{};
+        std::memcpy(start.data, prefix.data(), prefix.size());
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            const auto view = shards_[i].by_name_order.view();
+            Run run{after && !by_name(after->name, start) ? view.upper_bound(after->name) : view.lower_bound(start), view.end(), i};
+            if (seek(run)) heap.push_back(run);
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        page.todos.reserve(std::min(limit, std::size_t{4096}));
+        std::vector<std::pair<std::size_t, Name>> names; // (shard, name) of the next matches
+        while (!heap.empty() && page.todos.size() < limit) {
+            names.clear();
+            while (!heap.empty() && page.todos.size() + names.size() < limit) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                Run &run = heap.back();
+                names.emplace_back(run.shard, *run.it);
+                ++run.it;
+                if (seek(run)) {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                } else {
+                    heap.pop_back();
+                }
+            }
+            resolve(names, page.todos, [](std::size_t, const TodoDetails &) { return true; });
+        }
+        page.more = !heap.empty();
+        return page;
+    }
+
+    struct Filter {
+        std::optional<std::string_view> tag; // todos carrying this tag
+        uint8_t min_priority = 0;            // of at least this priority
+        uint64_t from = 0;                   // due in [from, to), to == UINT64_MAX: no upper bound
+        uint64_t to = UINT64_MAX;
+    };
+
+    // Up to `limit` todos matching filter by priority (highest first), then due time and name,
+    // starting strictly after the cursor `after` when given. The index keys are merged lock-free
+    // like search, which also completes the rows from by_name. With a tag the runs come from the
+    // tag index, else from the priority index, which holds only todos of priority 1 and up.
+    // Within a run each priority group is a seek to its first due time; where the due window
+    // ends the run seeks to the next group.
+    Page query(const Filter &filter, std::size_t limit, const std::optional<Todo> &after = std::nullopt) const {
+        using Name = jh::pod::array<char, 64>;
+        if (!filter.tag) {
+            if (filter.min_priority == 0) throw std::invalid_argument("Filter needs a tag or a priority of at least 1");
+            return priority_page(&Shard::by_priority, filter, limit, after,
+                                 [](const TodoPriorityKey &) { return true; },
+                                 [](uint8_t priority, uint64_t due, const Name &name) { return TodoPriorityKey{name, due, priority}; });
+        }
+
+        TodoTags tag{};
+        add_tag(tag, *filter.tag);
+        return priority_page(&Shard::by_tag, filter, limit, after,
+                             [&](const TodoTagKey &key) { return key.tag_view() == *filter.tag; },
+                             [&](uint8_t priority, uint64_t due, const Name &name) { return TodoTagKey{name, due, tag, priority}; });
+    }
+
     std::vector<Todo> unsafe_get_all() const {
         return range_before(UINT64_MAX);
     }
 
+    std::size_t size() const {
+        EpochGuard pin;
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            total += shards_[i].by_time.view().size();
+        }
+        return total;
+    }
+
+    std::size_t shard_count() const noexcept {
+        return shard_mask_ + 1;
+    }
+
     void clear() {
-        std::unique_lock lock(mutex_);
-        by_name_.clear();
-        by_time_.clear();
+        std::uint64_t lsn = 0;
+        {
+            auto locks = lock_all();
+            check_journal();
+            for (std::size_t i = 0; i < shard_count(); ++i) {
+                shards_[i].by_name.clear();
+                auto publish = shards_[i].batch();
+                shards_[i].by_time.clear();
+                shards_[i].by_name_order.clear();
+                shards_[i].by_priority.clear();
+                shards_[i].by_tag.clear();
+            }
+            changes_.record(ChangeLog::Kind::clear);
+            if (journal_) lsn = journal_->append_clear();
+        }
+        changed();
+        commit(lsn);
     }
 
     bool erase(std::string_view name) {
-        auto todo = get(name);
-        if (!todo) return false;
-        const auto&[nm, ts] = todo.value();
-        by_name_.erase(nm);
-        by_time_.erase(ts);
+        std::uint64_t lsn = 0;
+        {
+            Shard &shard = shard_for(name);
+            auto lock = lock_shard(shard);
+            check_journal();
+            auto *entry = shard.by_name.find(name);
+            if (!entry) return false;
+
+            const Todo todo = Todo::make(entry->key, entry->value);
+            changes_.record(ChangeLog::Kind::erase, todo);
+            if (journal_) lsn = journal_->append_erase(entry->key);
+            auto publish = shard.batch();
+            shard.by_time.erase(todo);
+            unindex(shard, todo);
+            shard.by_name.erase(entry);
+        }
+        changed();
+        commit(lsn);
         return true;
     }
 
+    // Holds every shard at once, so the cut is atomic and journals as one record
     void erase_before(uint64_t timestamp) {
-        std::unique_lock lock(mutex_);
+        std::uint64_t lsn = 0;
+        auto locks = lock_all();
+        check_journal();
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            Shard &shard = shards_[i];
+            auto publish = shard.batch();
+
+            auto end_it = shard.by_time.upper_bound(time_probe(timestamp));
+            std::size_t removed = 0;
+            for (auto it = shard.by_time.begin(); it != end_it; ++it, ++removed) {
+                shard.by_name.erase(it->name);
+            }
+            // the cut is scattered over the other orders: a large one is filtered in one pass
+            if (removed * 8 < shard.by_name_order.size()) {
+                for (auto it = shard.by_time.begin(); it != end_it; ++it) unindex(shard, *it);
+            } else {
+                auto due = [timestamp](const auto &key) { return key.due_timestamp <= timestamp; };
+                shard.by_name_order.erase_if([&](const jh::pod::array<char, 64> &name) { return !shard.by_name.contains(name); });
+                shard.by_priority.erase_if(due);
+                shard.by_tag.erase_if(due);
+            }
+            shard.by_time.erase_prefix(end_it);
+        }
+        Todo cut{};
+        cut.due_timestamp = timestamp;
+        changes_.record(ChangeLog::Kind::erase_before, cut);
+        if (journal_) lsn = journal_->append_erase_before(timestamp);
+        locks.clear();
+        changed();
+        commit(lsn);
+    }
 
-        auto end_it = by_time_.upper_bound(timestamp);
+    // Removes at most `limit` of the earliest todos due at or before timestamp from every shard,
+    // holding each shard's lock for one short slice only; returns how many were removed.
+    // Unlike erase_before the cut is not atomic across shards, so callers repeat it until it returns 0.
+    std::size_t expire(uint64_t timestamp, std::size_t limit) {
+        std::size_t removed = 0;
+        std::uint64_t lsn = 0;
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            Shard &shard = shards_[i];
+            auto lock = lock_shard(shard);
+            check_journal();
+            auto publish = shard.batch();
 
-        std::vector<std::pair<uint64_t, jh::pod::array<char, 64>>> to_erase;
-        to_erase.reserve(std::distance(by_time_.begin(), end_it));
+            const auto end_it = shard.by_time.upper_bound(time_probe(timestamp));
+            auto it = shard.by_time.begin();
+            for (std::size_t n = 0; n < limit && it != end_it; ++n, ++it) {
+                if (journal_) lsn = journal_->append_erase(it->name);
+                shard.by_name.erase(it->name);
+                unindex(shard, *it);
+                ++removed;
+            }
+            changes_.record_all(ChangeLog::Kind::expire, shard.by_time.begin(), it);
+            shard.by_time.erase_prefix(it);
+        }
+        if (removed) changed();
+        commit(lsn);
+        return removed;
+    }
 
-        std::copy(by_time_.begin(), end_it, std::back_inserter(to_erase));
+    // Bumped after every mutation, once its changes are visible: whatever is read from the
+    // store after observing generation g reflects at least every mutation up to g
+    std::uint64_t generation() const noexcept {
+        return generation_.load(std::memory_order_acquire);
+    }
 
-        for (const auto &[ts, name]: to_erase) {
-            by_name_.erase(name);
-            by_time_.erase(ts);
+    ChangeLog &changes() noexcept {
+        return changes_;
+    }
+
+    struct LockStats {
+        std::uint64_t waits = 0;   // acquisitions that found the shard lock taken
+        std::uint64_t wait_ns = 0; // time spent blocked in them
+    };
+
+    LockStats lock_stats() const noexcept {
+        LockStats stats;
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            stats.waits += shards_[i].waits.load(std::memory_order_relaxed);
+            stats.wait_ns += shards_[i].wait_ns.load(std::memory_order_relaxed);
         }
+        return stats;
     }
 
 private:
-    InMemoryTodoRepository() = default;
+    // one lock stripe: its own lock and its own indexes
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        mutable std::atomic<std::uint64_t> waits{0};   // only touched on contention, see lock_shard
+        mutable std::atomic<std::uint64_t> wait_ns{0};
+
+        // indexes by : name / time / name order / priority / tag; all but by_name are also lock-free via view()
+        FlatNameMap<TodoDetails> by_name;                     // under mutex only
+        SortedBlockIndex<Todo, TodoTimeLess> by_time;         // (due_timestamp, name), several todos may share a time
+        SortedBlockIndex<jh::pod::array<char, 64>, TodoNameLess> by_name_order; // names alone, for prefix search
+        SortedBlockIndex<TodoPriorityKey, TodoPriorityLess> by_priority; // (priority desc, due_timestamp, name) of todos with a priority
+        SortedBlockIndex<TodoTagKey, TodoTagLess> by_tag;                // (tag, priority desc, due_timestamp, name), one entry per tag
 
-    mutable std::shared_mutex mutex_;
+        // publishes every changed index once, when the scope ends
+        struct [[nodiscard]] Publish {
+            decltype(by_time)::Batch time;
+            decltype(by_name_order)::Batch names;
+            decltype(by_priority)::Batch priorities;
+            decltype(by_tag)::Batch tags;
+        };
+
+        Publish batch() {
+            return {by_time.batch(), by_name_order.batch(), by_priority.batch(), by_tag.batch()};
+        }
+    };
+
+    explicit InMemoryTodoRepository(std::size_t shards)
+            : shard_mask_(std::bit_ceil(std::clamp<std::size_t>(shards, 1, max_shards)) - 1),
+              shards_(std::make_unique<Shard[]>(shard_mask_ + 1)),
+              changes_(change_log_setting()) {}
+
+    static constexpr std::size_t max_shards = 1024;
+
+    static std::size_t &shard_setting() {
+        static std::size_t shards = std::bit_ceil(std::max(1u, std::thread::hardware_concurrency()));
+        return shards;
+    }
+
+    static std::size_t &change_log_setting() {
+        static std::size_t capacity = 0;
+        return capacity;
+    }
 
     friend CSVHandler;
+    friend SnapshotHandler;
+
+    std::size_t shard_mask_;
+    std::unique_ptr<Shard[]> shards_;
+    WriteAheadLog *journal_ = nullptr;
+    std::atomic<std::uint64_t> generation_{0};
+    ChangeLog changes_;
+
+    static constexpr std::size_t parallel_batch_rows = std::size_t{1} << 16; // rows per extra batch_add worker
+
+    // Merges one shard's part of a batch under its lock; returns the journal lsn (0 when not journaled)
+    std::uint64_t add_bucket(Shard &shard, std::pmr::vector<const Todo *> &bucket, bool log_rows) {
+        std::pmr::monotonic_buffer_resource pool;
+        auto lock = lock_shard(shard);
+        check_journal();
+        auto publish = shard.batch(); // readers see the whole bucket at once
 
-    // double index by : name / time
-    std::unordered_map<jh::pod::array<char, 64>, uint64_t, TodoNameHash, TodoNameEqual> by_name_;
-    std::map<uint64_t, jh::pod::array<char, 64>> by_time_;
+        // the last occurrence of a name in the batch wins (names compare up to their terminator)
+        std::stable_sort(bucket.begin(), bucket.end(), [](const Todo *a, const Todo *b) {
+            return std::strncmp(a->name.data, b->name.data, jh::pod::array<char, 64>::size()) < 0;
+        });
+
+        std::pmr::vector<Todo> time_index{&pool};
+        std::pmr::vector<TodoPriorityKey> priority_index{&pool};
+        std::pmr::vector<TodoTagKey> tag_index{&pool};
+        time_index.reserve(bucket.size());
+        shard.by_name.reserve(shard.by_name.size() + bucket.size());
+
+        for (std::size_t k = 0; k < bucket.size(); ++k) {
+            const Todo *todo = bucket[k];
+            if (k + 1 < bucket.size() && TodoNameEqual{}(todo->name, bucket[k + 1]->name)) continue;
+
+            auto [entry, inserted] = shard.by_name.try_emplace(todo->name, todo->details());
+            if (!inserted) {
+                if (entry->value == todo->details()) continue;
+                const Todo old = Todo::make(entry->key, entry->value);
+                shard.by_time.erase(old);
+                unindex(shard, old);
+                entry->value = todo->details();
+            }
+            const Todo stored = Todo::make(entry->key, entry->value);
+            time_index.push_back(stored);
+            if (stored.priority) priority_index.push_back(priority_key(stored));
+            for_each_tag_key(stored, [&](const TodoTagKey &tagged) { tag_index.push_back(tagged); });
+        }
+
+        // the bucket is in name order: one sorted run for the name index
+        const auto names = time_index | std::views::transform(&Todo::name);
+        shard.by_name_order.insert_sorted(names.begin(), names.end());
+        std::sort(priority_index.begin(), priority_index.end(), TodoPriorityLess{});
+        shard.by_priority.insert_sorted(priority_index.begin(), priority_index.end());
+        std::sort(tag_index.begin(), tag_index.end(), TodoTagLess{});
+        shard.by_tag.insert_sorted(tag_index.begin(), tag_index.end());
+        std::sort(time_index.begin(), time_index.end(), TodoTimeLess{});
+        shard.by_time.insert_sorted(time_index.begin(), time_index.end());
+        if (log_rows) changes_.record_all(ChangeLog::Kind::upsert, time_index.begin(), time_index.end());
+        if (journal_ && !time_index.empty()) return journal_->append_batch(time_index);
+        return 0;
+    }
+
+    // Applies one shard's operations of apply() in order under its lock; returns the last journal lsn
+    std::uint64_t apply_bucket(Shard &shard, const std::pmr::vector<std::size_t> &bucket,
+                               const std::vector<Operation> &ops, std::vector<OperationResult> &results) {
+        using Kind = Operation::Kind;
+        using Status = OperationResult::Status;
+
+        const bool read_only = std::all_of(bucket.begin(), bucket.end(), [&](std::size_t i) { return ops[i].kind == Kind::get; });
+        if (read_only) {
+            auto lock = share_shard(shard);
+            for (std::size_t i: bucket) {
+                const auto *entry = shard.by_name.find(ops[i].todo.name);
+                results[i] = entry ? OperationResult{Status::found, entry->value} : OperationResult{Status::not_found};
+            }
+            return 0;
+        }
+
+        std::uint64_t lsn = 0;
+        auto lock = lock_shard(shard);
+        check_journal();
+        auto publish = shard.batch(); // readers see the shard's part of the batch at once
+        for (std::size_t i: bucket) {
+            const Todo &todo = ops[i].todo;
+            switch (ops[i].kind) {
+                case Kind::get: {
+                    const auto *entry = shard.by_name.find(todo.name);
+                    results[i] = entry ? OperationResult{Status::found, entry->value} : OperationResult{Status::not_found};
+                    break;
+                }
+                case Kind::create: {
+                    const auto [entry, inserted] = shard.by_name.try_emplace(todo.name, todo.details());
+                    if (!inserted) {
+                        results[i] = {Status::exists};
+                        break;
+                    }
+                    // the map's copy of the name: the caller's may carry bytes past its terminator
+                    const Todo stored = Todo::make(entry->key, entry->value);
+                    shard.by_time.insert(stored);
+                    index(shard, stored);
+                    changes_.record(ChangeLog::Kind::create, stored);
+                    if (journal_) lsn = journal_->append_add(stored);
+                    results[i] = {Status::created};
+                    break;
+                }
+                case Kind::upsert: {
+                    auto [entry, inserted] = shard.by_name.try_emplace(todo.name, todo.details());
+                    results[i] = {inserted ? Status::created : Status::updated};
+                    if (!inserted) {
+                        if (entry->value == todo.details()) break;
+                        const Todo old = Todo::make(entry->key, entry->value);
+                        shard.by_time.erase(old);
+                        unindex(shard, old);
+                        entry->value = todo.details();
+                    }
+                    const Todo stored = Todo::make(entry->key, entry->value);
+                    shard.by_time.insert(stored);
+                    index(shard, stored);
+                    changes_.record(ChangeLog::Kind::upsert, stored);
+                    // batch_add replays as an upsert
+                    if (journal_) lsn = journal_->append_batch(std::array<Todo, 1>{stored});
+                    break;
+                }
+                case Kind::erase: {
+                    auto *entry = shard.by_name.find(todo.name);
+                    if (!entry) {
+                        results[i] = {Status::not_found};
+                        break;
+                    }
+                    const Todo old = Todo::make(entry->key, entry->value);
+                    changes_.record(ChangeLog::Kind::erase, old);
+                    if (journal_) lsn = journal_->append_erase(entry->key);
+                    shard.by_time.erase(old);
+                    unindex(shard, old);
+                    shard.by_name.erase(entry);
+                    results[i] = {Status::deleted};
+                    break;
+                }
+            }
+        }
+        return lsn;
+    }
+
+    // query() over one (…, priority desc, due, name) index: in_scope bounds the index prefix
+    // being read, key_of(priority, due, name) makes the entry at that position
+    template<typename Entry, typename Less, typename InScope, typename KeyOf>
+    Page priority_page(SortedBlockIndex<Entry, Less> Shard::*index, const Filter &filter, std::size_t limit,
+                       const std::optional<Todo> &after, InScope in_scope, KeyOf key_of) const {
+        using Name = jh::pod::array<char, 64>;
+        using View = decltype((shards_[0].*index).view());
+        using Iterator = decltype(std::declval<View>().begin());
+        struct Run {
+            View view;
+            Iterator it;
+            std::size_t shard;
+        };
+        const TodoPriorityLess by_priority{};
+        auto later = [&](const Run &a, const Run &b) { return by_priority(*b.it, *a.it); };
+
+        // moves to the run's next entry inside the filter; false once there is none
+        auto seek = [&](Run &run) {
+            while (run.it != run.view.end() && in_scope(*run.it)) {
+                const Entry &entry = *run.it;
+                if (entry.priority < filter.min_priority) return false;
+                if (entry.due_timestamp < filter.from) {
+                    run.it = run.view.lower_bound(key_of(entry.priority, filter.from, Name{}));
+                } else if (entry.due_timestamp >= filter.to && filter.to != UINT64_MAX) {
+                    if (entry.priority == filter.min_priority) return false;
+                    run.it = run.view.lower_bound(key_of(static_cast<uint8_t>(entry.priority - 1), filter.from, Name{}));
+                } else {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        Page page;
+        EpochGuard pin;
+        std::vector<Run> heap;
+        heap.reserve(shard_count());
+
+        for (std::size_t i = 0; i < shard_count(); ++i) {
+            const auto view = (shards_[i].*index).view();
+            Run run{view, after ? view.upper_bound(key_of(after->priority, after->due_timestamp, after->name))
+                                : view.lower_bound(key_of(UINT8_MAX, filter.from, Name{})), i};
+            if (seek(run)) heap.push_back(run);
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        // the entries hold the keys only: each batch of matches is completed from by_name, and one
+        // that changed since it was filed is skipped (its new entry, if any, is merged on its own)
+        page.todos.reserve(std::min(limit, std::size_t{4096}));
+        std::vector<std::pair<std::size_t, Name>> names;
+        std::vector<std::pair<uint8_t, uint64_t>> positions;
+        while (!heap.empty() && page.todos.size() < limit) {
+            names.clear();
+            positions.clear();
+            while (!heap.empty() && page.todos.size() + names.size() < limit) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                Run &run = heap.back();
+                names.emplace_back(run.shard, run.it->name);
+                positions.emplace_back(run.it->priority, run.it->due_timestamp);
+                ++run.it;
+                if (seek(run)) {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                } else {
+                    heap.pop_back();
+                }
+            }
+            resolve(names, page.todos, [&](std::size_t i, const TodoDetails &details) {
+                return positions[i] == std::pair{details.priority, details.due_timestamp};
+            });
+        }
+        page.more = !heap.empty();
+        return page;
+    }
+
+    // Appends the todos of (shard, name) pairs still present and accepted by keep(pair index, details),
+    // in the pairs' order
+    template<typename Keep>
+    void resolve(const std::vector<std::pair<std::size_t, jh::pod::array<char, 64>>> &names, std::vector<Todo> &out,
+                 Keep keep) const {
+        std::vector<std::size_t> order(names.size());
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return names[a].first < names[b].first; });
+
+        std::vector<std::optional<TodoDetails>> details(names.size());
+        for (std::size_t k = 0; k < order.size();) {
+            const Shard &shard = shards_[names[order[k]].first];
+            auto lock = share_shard(shard);
+            for (; k < order.size() && &shards_[names[order[k]].first] == &shard; ++k) {
+                if (const auto *entry = shard.by_name.find(names[order[k]].second)) details[order[k]] = entry->value;
+            }
+        }
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            if (details[i] && keep(i, *details[i])) out.push_back(Todo::make(names[i].second, *details[i]));
+        }
+    }
+
+    static TodoPriorityKey priority_key(const Todo &todo) noexcept {
+        return {todo.name, todo.due_timestamp, todo.priority};
+    }
+
+    // Calls f(key) for every tag of todo
+    template<typename F>
+    static void for_each_tag_key(const Todo &todo, F &&f) {
+        for_each_tag(todo.tags, [&](std::size_t offset, std::size_t size) {
+            TodoTagKey key{todo.name, todo.due_timestamp, {}, todo.priority};
+            std::memcpy(key.tag.data, todo.tags.data + offset, size);
+            f(key);
+        });
+    }
+
+    // files todo in the secondary indexes (all but by_name and by_time); under the shard lock
+    static void index(Shard &shard, const Todo &todo) {
+        shard.by_name_order.insert(todo.name);
+        if (todo.priority) shard.by_priority.insert(priority_key(todo));
+        for_each_tag_key(todo, [&](const TodoTagKey &key) { shard.by_tag.insert(key); });
+    }
+
+    static void unindex(Shard &shard, const Todo &todo) {
+        shard.by_name_order.erase(todo.name);
+        if (todo.priority) shard.by_priority.erase(priority_key(todo));
+        for_each_tag_key(todo, [&](const TodoTagKey &key) { shard.by_tag.erase(key); });
+    }
+
+    // Calls f(worker, shard) for every shard, shards striped over `workers` threads
+    // (the calling thread included). The first exception is rethrown after all joined.
+    template<typename F>
+    void for_each_shard(std::size_t workers, F &&f) {
+        auto stripe = [&](std::size_t worker) {
+            for (std::size_t i = worker; i < shard_count(); i += workers) f(worker, i);
+        };
+        if (workers <= 1) return stripe(0);
+
+        std::vector<std::exception_ptr> errors(workers);
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+        for (std::size_t w = 1; w < workers; ++w) {
+            threads.emplace_back([&, w] {
+                try {
+                    stripe(w);
+                } catch (...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        try {
+            stripe(0);
+        } catch (...) {
+            errors[0] = std::current_exception();
+        }
+        for (auto &t: threads) t.join();
+        for (const auto &error: errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+
+    // Shard locks that try first and time only a contended acquisition, so the
+    // uncontended path costs one try_lock and touches no counter
+    static std::unique_lock<std::shared_mutex> lock_shard(Shard &shard) {
+        std::unique_lock lock(shard.mutex, std::try_to_lock);
+        if (!lock) {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            count_wait(shard, start);
+        }
+        return lock;
+    }
+
+    static std::shared_lock<std::shared_mutex> share_shard(const Shard &shard) {
+        std::shared_lock lock(shard.mutex, std::try_to_lock);
+        if (!lock) {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            count_wait(shard, start);
+        }
+        return lock;
+    }
+
+    static void count_wait(const Shard &shard, std::chrono::steady_clock::time_point start) noexcept {
+        const auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        shard.waits.fetch_add(1, std::memory_order_relaxed);
+        shard.wait_ns.fetch_add(static_cast<std::uint64_t>(waited.count()), std::memory_order_relaxed);
+    }
+
+    void changed() noexcept {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    void commit(std::uint64_t lsn) {
+        if (lsn) journal_->commit(lsn);
+    }
+
+    // Refuses a write once the journal has failed, before anything is applied (caller holds the lock)
+    void check_journal() const {
+        if (journal_) journal_->check_writable();
+    }
+
+    // exclusive locks on every shard, always taken in index order
+    std::vector<std::unique_lock<std::shared_mutex>> lock_all() {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(shard_count());
+        for (std::size_t i = 0; i < shard_count(); ++i) locks.push_back(lock_shard(shards_[i]));
+        return locks;
+    }
+
+    // shared locks on every shard, same order: a consistent read of the whole repository
+    std::vector<std::shared_lock<std::shared_mutex>> share_all() const {
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(shard_count());
+        for (std::size_t i = 0; i < shard_count(); ++i) locks.push_back(share_shard(shards_[i]));
+        return locks;
+    }
+
+    // top hash bits pick the shard, leaving the low bits to the per-shard tables
+    std::size_t shard_index(std::string_view name) const noexcept {
+        const std::uint64_t h = TodoNameHash{}(name) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h >> 32) & shard_mask_;
+    }
+
+    std::size_t shard_index(const jh::pod::array<char, 64> &name) const noexcept {
+        const std::uint64_t h = TodoNameHash{}(name) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h >> 32) & shard_mask_;
+    }
+
+    template<typename Key>
+    Shard &shard_for(const Key &name) noexcept {
+        return shards_[shard_index(name)];
+    }
+
+    template<typename Key>
+    const Shard &shard_for(const Key &name) const noexcept {
+        return shards_[shard_index(name)];
+    }
+
+    // sorts after every todo due at or before timestamp
+    static Todo time_probe(uint64_t timestamp) noexcept {
+        Todo probe;
+        std::memset(probe.name.data, 0xFF, jh::pod::array<char, 64>::size());
+        probe.due_timestamp = timestamp;
+        return probe;
+    }
+
+    // merges consecutive time-sorted runs [runs[i], runs[i+1]) pairwise, O(n log k)
+    static void merge_runs(std::vector<Todo> &todos, std::vector<std::size_t> &runs) {
+        const TodoTimeLess by_time{};
+        while (runs.size() > 2) {
+            std::size_t kept = 1;
+            for (std::size_t i = 0; i + 2 < runs.size(); i += 2) {
+                std::inplace_merge(todos.begin() + static_cast<std::ptrdiff_t>(runs[i]),
+                                   todos.begin() + static_cast<std::ptrdiff_t>(runs[i + 1]),
+                                   todos.begin() + static_cast<std::ptrdiff_t>(runs[i + 2]), by_time);
+                runs[kept++] = runs[i + 2];
+            }
+            if (runs.size() % 2 == 0) runs[kept++] = runs.back();
+            runs.resize(kept);
+        }
+    }
 };
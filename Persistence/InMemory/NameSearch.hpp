@@ -0,0 +1,79 @@
+#pragma once
+
+#include <jh/pod>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "../../Entity/Todo.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Substring test over zero-padded 64-byte names. Every start position is filtered at once by
+// comparing the needle's first and last byte against the name with SIMD; only positions
+// where both match are verified with memcmp. A matcher is used by one thread at a time.
+class SubstringMatcher {
+public:
+    explicit SubstringMatcher(std::string_view needle) : needle_(needle) {
+        if (needle.empty() || needle.size() >= name_size || needle.find('\0') != std::string_view::npos) {
+            throw std::invalid_argument("Invalid substring");
+        }
+    }
+
+    bool operator()(const jh::pod::array<char, 64> &name) {
+        // the tail past the name stays zero, which no needle byte equals
+        std::memcpy(buf_, name.data, name_size);
+        const std::size_t m = needle_.size();
+
+#if defined(__AVX2__)
+        const __m256i first = _mm256_set1_epi8(needle_.front());
+        const __m256i last = _mm256_set1_epi8(needle_.back());
+        for (std::size_t off = 0; off + m <= name_size; off += 32) {
+            const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(buf_ + off));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf_ + off + m - 1));
+            if (verify(static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)))), off)) return true;
+        }
+        return false;
+#elif defined(__SSE2__) || defined(_M_X64)
+        const __m128i first = _mm_set1_epi8(needle_.front());
+        const __m128i last = _mm_set1_epi8(needle_.back());
+        for (std::size_t off = 0; off + m <= name_size; off += 16) {
+            const __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(buf_ + off));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf_ + off + m - 1));
+            if (verify(static_cast<std::uint32_t>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)))), off)) return true;
+        }
+        return false;
+#else
+        return std::string_view(buf_, strnlen(buf_, name_size)).find(needle_) != std::string_view::npos;
+#endif
+    }
+
+private:
+    static constexpr std::size_t name_size = jh::pod::array<char, 64>::size();
+
+    std::string_view needle_;
+    alignas(32) char buf_[2 * name_size]{};
+
+    // candidates of one block: bit i set when position off + i matches first and last byte
+    [[maybe_unused]] bool verify(std::uint32_t mask, std::size_t off) const noexcept {
+        const std::size_t m = needle_.size();
+        while (mask) {
+            const std::size_t pos = off + static_cast<std::size_t>(std::countr_zero(mask));
+            if (m <= 2 || std::memcmp(buf_ + pos + 1, needle_.data() + 1, m - 2) == 0) return true;
+            mask &= mask - 1;
+        }
+        return false;
+    }
+};
+
+// true when the zero-padded name starts with prefix (which holds no '\0')
+inline bool has_prefix(const jh::pod::array<char, 64> &name, std::string_view prefix) noexcept {
+    return std::memcmp(name.data, prefix.data(), prefix.size()) == 0;
+}
@@ -0,0 +1,558 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "Epoch.hpp"
+
+// Ordered multiset stored as a list of sorted, fixed-capacity blocks, grouped into nodes.
+// Lookups binary-search the fence arrays (last key of each node and block) and then the
+// block, range scans walk whole blocks sequentially, and a node is allocated per block
+// instead of per entry.
+//
+// Versions are published RCU-style. Writers (serialized by the caller's lock) never touch
+// a block, node or node list that may be visible: they copy what they change into a private
+// draft, publish it with one atomic store and retire the replaced pieces to epoch-based
+// reclamation. Blocks are small and the root only lists nodes, so a write copies one block,
+// one node of block pointers and the short node list rather than every block pointer.
+// Readers either hold the caller's lock and use the members below, or pin an EpochGuard
+// and scan view() with no lock at all.
+template<typename T, typename Less = std::less<T>, std::size_t BlockCapacity = 32, std::size_t NodeCapacity = 64>
+class SortedBlockIndex {
+    static_assert(BlockCapacity >= 4, "blocks must hold at least 4 entries");
+    static_assert(NodeCapacity >= 4, "nodes must hold at least 4 blocks");
+    static_assert(std::is_trivially_copyable_v<T>, "blocks are copied wholesale");
+
+    struct Block {
+        std::size_t size = 0;
+        std::uint64_t version = 0; // draft that allocated it; writable only within that draft
+        T items[BlockCapacity];
+
+        const T &back() const noexcept { return items[size - 1]; }
+    };
+
+    struct Node {
+        std::size_t size = 0;      // blocks in use
+        std::uint64_t version = 0; // as for blocks
+        Block *blocks[NodeCapacity]{};
+
+        const T &back() const noexcept { return blocks[size - 1]->back(); }
+    };
+
+    struct Root {
+        std::vector<Node *> nodes;
+        std::size_t size = 0;
+    };
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T *;
+        using reference = const T &;
+
+        const_iterator() = default;
+
+        reference operator*() const { return block()->items[pos_]; }
+
+        pointer operator->() const { return &block()->items[pos_]; }
+
+        const_iterator &operator++() {
+            if (++pos_ == block()->size) {
+                pos_ = 0;
+                if (++block_ == root_->nodes[node_]->size) {
+                    block_ = 0;
+                    ++node_;
+                }
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator &other) const {
+            return node_ == other.node_ && block_ == other.block_ && pos_ == other.pos_;
+        }
+
+    private:
+        friend SortedBlockIndex;
+
+        const_iterator(const Root *root, std::size_t node, std::size_t block, std::size_t pos)
+                : root_(root), node_(node), block_(block), pos_(pos) {}
+
+        const Block *block() const { return root_->nodes[node_]->blocks[block_]; }
+
+        const Root *root_ = nullptr;
+        std::size_t node_ = 0;
+        std::size_t block_ = 0;
+        std::size_t pos_ = 0;
+    };
+
+    // One published version. Valid while the reader's EpochGuard (or the caller's lock) is held.
+    class View {
+    public:
+        [[nodiscard]] std::size_t size() const noexcept { return root_->size; }
+
+        [[nodiscard]] bool empty() const noexcept { return root_->size == 0; }
+
+        const_iterator begin() const { return {root_, 0, 0, 0}; }
+
+        const_iterator end() const { return {root_, root_->nodes.size(), 0, 0}; }
+
+        const_iterator lower_bound(const T &key) const {
+            return bound(key, [](const T &a, const T &b) { return Less{}(a, b); });
+        }
+
+        const_iterator upper_bound(const T &key) const {
+            return bound(key, [](const T &a, const T &b) { return !Less{}(b, a); });
+        }
+
+    private:
+        friend SortedBlockIndex;
+
+        explicit View(const Root *root) : root_(root) {}
+
+        const Root *root_;
+
+        // no fence arrays in a published version: probes read each node's and block's last key
+        template<typename Pred>
+        const_iterator bound(const T &key, Pred before) const {
+            const auto &nodes = root_->nodes;
+            auto found = std::partition_point(nodes.begin(), nodes.end(),
+                                              [&](const Node *n) { return before(n->back(), key); });
+            if (found == nodes.end()) return end();
+            const Node *node = *found;
+            auto block = std::partition_point(node->blocks, node->blocks + node->size,
+                                              [&](const Block *b) { return before(b->back(), key); });
+            auto pos = std::partition_point((*block)->items, (*block)->items + (*block)->size,
+                                            [&](const T &v) { return before(v, key); });
+            return {root_, static_cast<std::size_t>(found - nodes.begin()), static_cast<std::size_t>(block - node->blocks),
+                    static_cast<std::size_t>(pos - (*block)->items)};
+        }
+    };
+
+    // Defers publishing until the outermost Batch ends, so a multi-step update
+    // becomes visible at once and copies each touched block only once
+    class [[nodiscard]] Batch {
+    public:
+        explicit Batch(SortedBlockIndex &index) : index_(index) { ++index_.deferred_; }
+
+        ~Batch() {
+            if (--index_.deferred_ == 0) index_.publish();
+        }
+
+        Batch(const Batch &) = delete;
+
+        Batch &operator=(const Batch &) = delete;
+
+    private:
+        SortedBlockIndex &index_;
+    };
+
+    static constexpr std::size_t block_capacity = BlockCapacity;
+
+    SortedBlockIndex() : published_(new Root) {}
+
+    SortedBlockIndex(const SortedBlockIndex &) = delete;
+
+    SortedBlockIndex &operator=(const SortedBlockIndex &) = delete;
+
+    ~SortedBlockIndex() {
+        publish();
+        Root *root = published_.load();
+        for (Node *node: root->nodes) {
+            for (std::size_t i = 0; i < node->size; ++i) delete node->blocks[i];
+            delete node;
+        }
+        delete root;
+    }
+
+    // the latest published version, for lock-free readers holding an EpochGuard
+    View view() const noexcept {
+        return View(published_.load(std::memory_order_seq_cst));
+    }
+
+    Batch batch() {
+        return Batch(*this);
+    }
+
+    // Reads below see the writer's latest state; call them under the caller's lock
+
+    [[nodiscard]] std::size_t size() const noexcept { return current()->size; }
+
+    [[nodiscard]] bool empty() const noexcept { return current()->size == 0; }
+
+    const_iterator begin() const { return {current(), 0, 0, 0}; }
+
+    const_iterator end() const { return {current(), current()->nodes.size(), 0, 0}; }
+
+    const_iterator lower_bound(const T &key) const {
+        return bound(key, [this](const T &a, const T &b) { return less_(a, b); });
+    }
+
+    const_iterator upper_bound(const T &key) const {
+        return bound(key, [this](const T &a, const T &b) { return !less_(b, a); });
+    }
+
+    void clear() {
+        Batch batch(*this);
+        Root &root = draft();
+        for (Node *node: root.nodes) drop_node(node);
+        root.nodes.clear();
+        root.size = 0;
+        fences_.clear();
+    }
+
+    void insert(const T &value) {
+        Batch batch(*this);
+        Root &root = draft();
+        ++root.size;
+        if (root.nodes.empty()) {
+            Node *node = new_node();
+            Block *block = new_block();
+            block->items[0] = value;
+            block->size = 1;
+            node->blocks[0] = block;
+            node->size = 1;
+            root.nodes.push_back(node);
+            fences_.push_back({value});
+            return;
+        }
+
+        // first block whose last key is not less than value, or the last block
+        std::size_t n = 0, b = 0;
+        const auto node_fence = std::lower_bound(fences_.begin(), fences_.end(), value,
+                                                 [this](const std::vector<T> &f, const T &v) { return less_(f.back(), v); });
+        if (node_fence == fences_.end()) {
+            n = fences_.size() - 1;
+            b = fences_[n].size() - 1;
+        } else {
+            n = std::distance(fences_.begin(), node_fence);
+            b = std::distance(node_fence->begin(), std::lower_bound(node_fence->begin(), node_fence->end(), value, less_));
+        }
+
+        Block *block = writable(n, b);
+        T *pos = std::upper_bound(block->items, block->items + block->size, value, less_);
+        std::copy_backward(pos, block->items + block->size, block->items + block->size + 1);
+        *pos = value;
+        ++block->size;
+        fences_[n][b] = block->back();
+
+        if (block->size == BlockCapacity) split(n, b);
+    }
+
+    // removes one entry equivalent to value
+    bool erase(const T &value) {
+        auto it = lower_bound(value);
+        if (it == end() || less_(value, *it)) return false;
+        Batch batch(*this);
+        erase_at(it.node_, it.block_, it.pos_);
+        return true;
+    }
+
+    // removes [begin(), until)
+    void erase_prefix(const_iterator until) {
+        Batch batch(*this);
+        Root &root = draft();
+        for (std::size_t n = 0; n < until.node_; ++n) {
+            root.size -= node_entries(root.nodes[n]);
+            drop_node(root.nodes[n]);
+        }
+        root.nodes.erase(root.nodes.begin(), root.nodes.begin() + static_cast<std::ptrdiff_t>(until.node_));
+        fences_.erase(fences_.begin(), fences_.begin() + static_cast<std::ptrdiff_t>(until.node_));
+        if (root.nodes.empty()) return;
+
+        if (until.block_ > 0) {
+            Node *node = writable_node(0);
+            for (std::size_t b = 0; b < until.block_; ++b) {
+                root.size -= node->blocks[b]->size;
+                drop(node->blocks[b]);
+            }
+            std::copy(node->blocks + until.block_, node->blocks + node->size, node->blocks);
+            node->size -= until.block_;
+            fences_[0].erase(fences_[0].begin(), fences_[0].begin() + static_cast<std::ptrdiff_t>(until.block_));
+        }
+        if (until.pos_ > 0) {
+            Block *block = writable(0, 0);
+            std::copy(block->items + until.pos_, block->items + block->size, block->items);
+            block->size -= until.pos_;
+            root.size -= until.pos_;
+        }
+    }
+
+    // Removes every entry matching pred, rebuilding the blocks in a single pass;
+    // returns how many were removed
+    template<typename Pred>
+    std::size_t erase_if(Pred pred) {
+        std::vector<T> kept;
+        kept.reserve(size());
+        std::copy_if(begin(), end(), std::back_inserter(kept), [&](const T &v) { return !pred(v); });
+        const std::size_t removed = size() - kept.size();
+        if (removed == 0) return 0;
+
+        Batch batch(*this);
+        rebuild(kept);
+        return removed;
+    }
+
+    // Adds a run already sorted by Less. Small runs are inserted one by one,
+    // large ones are merged and the blocks are rebuilt in a single pass.
+    template<typename It>
+    void insert_sorted(It first, It last) {
+        const auto count = static_cast<std::size_t>(std::distance(first, last));
+        if (count == 0) return;
+
+        Batch batch(*this);
+        if (count * 8 < size()) {
+            for (; first != last; ++first) insert(*first);
+            return;
+        }
+
+        std::vector<T> merged;
+        merged.reserve(size() + count);
+        std::merge(begin(), end(), first, last, std::back_inserter(merged), less_);
+        rebuild(merged);
+    }
+
+private:
+    Less less_{};
+    std::atomic<Root *> published_;
+    Root *draft_ = nullptr;              // unpublished successor of published_, owned by the writer
+    std::vector<Block *> replaced_;      // published blocks the draft no longer uses
+    std::vector<Node *> replaced_nodes_; // and published nodes
+    std::vector<std::vector<T>> fences_; // last key of every block, per node, of the writer's latest state
+    std::uint64_t version_ = 1;          // version of the current draft's blocks and nodes
+    std::size_t deferred_ = 0;           // open Batch scopes
+    RetireList retired_;
+
+    const Root *current() const noexcept {
+        return draft_ ? draft_ : published_.load(std::memory_order_relaxed);
+    }
+
+    // the node list is copied once per published version; nodes and blocks only when changed
+    Root &draft() {
+        if (!draft_) draft_ = new Root(*published_.load(std::memory_order_relaxed));
+        return *draft_;
+    }
+
+    Block *new_block() {
+        Block *block = new Block;
+        block->version = version_;
+        return block;
+    }
+
+    Node *new_node() {
+        Node *node = new Node;
+        node->version = version_;
+        return node;
+    }
+
+    // node n of the draft, copied first if a published version can still see it
+    Node *writable_node(std::size_t n) {
+        Root &root = draft();
+        Node *node = root.nodes[n];
+        if (node->version == version_) return node;
+        Node *copy = new Node(*node);
+        copy->version = version_;
+        replaced_nodes_.push_back(node);
+        root.nodes[n] = copy;
+        return copy;
+    }
+
+    // block b of node n of the draft, likewise
+    Block *writable(std::size_t n, std::size_t b) {
+        Node *node = writable_node(n);
+        Block *block = node->blocks[b];
+        if (block->version == version_) return block;
+        Block *copy = new Block(*block);
+        copy->version = version_;
+        replaced_.push_back(block);
+        node->blocks[b] = copy;
+        return copy;
+    }
+
+    // forgets a block of the draft: freed now if only the draft ever saw it
+    void drop(Block *block) {
+        if (block->version == version_) {
+            delete block;
+        } else {
+            replaced_.push_back(block);
+        }
+    }
+
+    // forgets a node and every block in it
+    void drop_node(Node *node) {
+        for (std::size_t b = 0; b < node->size; ++b) drop(node->blocks[b]);
+        if (node->version == version_) {
+            delete node;
+        } else {
+            replaced_nodes_.push_back(node);
+        }
+    }
+
+    static std::size_t node_entries(const Node *node) {
+        std::size_t count = 0;
+        for (std::size_t b = 0; b < node->size; ++b) count += node->blocks[b]->size;
+        return count;
+    }
+
+    void publish() {
+        if (!draft_) return;
+        Root *old = published_.exchange(draft_, std::memory_order_seq_cst);
+        draft_ = nullptr;
+        ++version_;
+        retired_.retire(old);
+        for (Block *block: replaced_) retired_.retire(block);
+        for (Node *node: replaced_nodes_) retired_.retire(node);
+        replaced_.clear();
+        replaced_nodes_.clear();
+    }
+
+    template<typename Pred>
+    const_iterator bound(const T &key, Pred before) const {
+        // first node, then first block in it, whose last key does not satisfy before(last, key)
+        auto node_fence = std::partition_point(fences_.begin(), fences_.end(),
+                                               [&](const std::vector<T> &f) { return before(f.back(), key); });
+        if (node_fence == fences_.end()) return end();
+        auto fence = std::partition_point(node_fence->begin(), node_fence->end(),
+                                          [&](const T &last) { return before(last, key); });
+
+        const std::size_t n = std::distance(fences_.begin(), node_fence);
+        const std::size_t b = std::distance(node_fence->begin(), fence);
+        const Block *block = current()->nodes[n]->blocks[b];
+        auto pos = std::partition_point(block->items, block->items + block->size, [&](const T &v) { return before(v, key); });
+        return {current(), n, b, static_cast<std::size_t>(pos - block->items)};
+    }
+
+    // a full block b of node n is halved; a node that fills up in turn is halved too
+    void split(std::size_t n, std::size_t b) {
+        Node *node = writable_node(n);
+        Block *block = node->blocks[b];
+        Block *upper = new_block();
+        const std::size_t half = block->size / 2;
+        upper->size = block->size - half;
+        std::copy(block->items + half, block->items + block->size, upper->items);
+        block->size = half;
+
+        std::copy_backward(node->blocks + b + 1, node->blocks + node->size, node->blocks + node->size + 1);
+        node->blocks[b + 1] = upper;
+        ++node->size;
+        fences_[n][b] = block->back();
+        fences_[n].insert(fences_[n].begin() + static_cast<std::ptrdiff_t>(b + 1), upper->back());
+
+        if (node->size == NodeCapacity) split_node(n);
+    }
+
+    void split_node(std::size_t n) {
+        Root &root = draft();
+        Node *node = root.nodes[n];
+        Node *upper = new_node();
+        const std::size_t half = node->size / 2;
+        upper->size = node->size - half;
+        std::copy(node->blocks + half, node->blocks + node->size, upper->blocks);
+        node->size = half;
+
+        root.nodes.insert(root.nodes.begin() + static_cast<std::ptrdiff_t>(n + 1), upper);
+        std::vector<T> upper_fences(fences_[n].begin() + static_cast<std::ptrdiff_t>(half), fences_[n].end());
+        fences_[n].resize(half);
+        fences_.insert(fences_.begin() + static_cast<std::ptrdiff_t>(n + 1), std::move(upper_fences));
+    }
+
+    void erase_at(std::size_t n, std::size_t b, std::size_t pos) {
+        Root &root = draft();
+        Block *block = writable(n, b);
+        Node *node = root.nodes[n];
+        std::copy(block->items + pos + 1, block->items + block->size, block->items + pos);
+        --block->size;
+        --root.size;
+
+        if (block->size == 0) {
+            drop(block);
+            remove_block(n, b);
+            return;
+        }
+        fences_[n][b] = block->back();
+
+        // fold an underfull block into its successor in the node to keep blocks dense
+        if (block->size < BlockCapacity / 4 && b + 1 < node->size
+            && block->size + node->blocks[b + 1]->size < BlockCapacity) {
+            Block *next = writable(n, b + 1);
+            std::copy_backward(next->items, next->items + next->size, next->items + next->size + block->size);
+            std::copy(block->items, block->items + block->size, next->items);
+            next->size += block->size;
+            drop(block);
+            remove_block(n, b);
+        }
+    }
+
+    // takes block b out of node n (already writable); an emptied node goes too,
+    // an underfull one is folded into its successor
+    void remove_block(std::size_t n, std::size_t b) {
+        Root &root = draft();
+        Node *node = root.nodes[n];
+        std::copy(node->blocks + b + 1, node->blocks + node->size, node->blocks + b);
+        --node->size;
+        fences_[n].erase(fences_[n].begin() + static_cast<std::ptrdiff_t>(b));
+
+        if (node->size == 0) {
+            drop_node(node);
+            root.nodes.erase(root.nodes.begin() + static_cast<std::ptrdiff_t>(n));
+            fences_.erase(fences_.begin() + static_cast<std::ptrdiff_t>(n));
+            return;
+        }
+        if (node->size < NodeCapacity / 4 && n + 1 < root.nodes.size()
+            && node->size + root.nodes[n + 1]->size < NodeCapacity) {
+            Node *next = writable_node(n + 1);
+            std::copy_backward(next->blocks, next->blocks + next->size, next->blocks + next->size + node->size);
+            std::copy(node->blocks, node->blocks + node->size, next->blocks);
+            next->size += node->size;
+            fences_[n + 1].insert(fences_[n + 1].begin(), fences_[n].begin(), fences_[n].end());
+            node->size = 0; // its blocks now belong to next
+            drop_node(node);
+            root.nodes.erase(root.nodes.begin() + static_cast<std::ptrdiff_t>(n));
+            fences_.erase(fences_.begin() + static_cast<std::ptrdiff_t>(n));
+        }
+    }
+
+    // packs sorted values into blocks filled to 3/4, and blocks into nodes likewise,
+    // leaving room for later inserts
+    void rebuild(const std::vector<T> &sorted) {
+        constexpr std::size_t fill = BlockCapacity * 3 / 4;
+        constexpr std::size_t node_fill = NodeCapacity * 3 / 4;
+        Root &root = draft();
+        for (Node *node: root.nodes) drop_node(node);
+        root.nodes.clear();
+        fences_.clear();
+        const std::size_t blocks = (sorted.size() + fill - 1) / fill;
+        root.nodes.reserve(blocks / node_fill + 1);
+        fences_.reserve(blocks / node_fill + 1);
+
+        for (std::size_t i = 0; i < sorted.size(); i += fill) {
+            if (root.nodes.empty() || root.nodes.back()->size == node_fill) {
+                root.nodes.push_back(new_node());
+                fences_.emplace_back();
+                fences_.back().reserve(node_fill);
+            }
+            const std::size_t n = std::min(fill, sorted.size() - i);
+            Block *block = new_block();
+            std::copy(sorted.begin() + static_cast<std::ptrdiff_t>(i),
+                      sorted.begin() + static_cast<std::ptrdiff_t>(i + n), block->items);
+            block->size = n;
+            Node *node = root.nodes.back();
+            node->blocks[node->size++] = block;
+            fences_.back().push_back(block->back());
+        }
+        root.size = sorted.size();
+    }
+};
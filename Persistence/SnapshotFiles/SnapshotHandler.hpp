@@ -0,0 +1,253 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <bit>
+#include <algorithm>
+#include <ranges>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../Entity/Todo.hpp"
+#include "../InMemory/InMemoryTodoRepository.hpp"
+#include "../WalFiles/WriteAheadLog.hpp"
+
+static_assert(sizeof(Todo) == 96, "snapshot records are raw 96-byte Todo values");
+
+// Binary point-in-time image of the repository.
+//
+// File layout: a 64-byte Header, then `count` raw Todo records sorted by TodoTimeLess.
+// Version 1 files hold 72-byte records without priority and tags; they still load.
+// Integers are stored in host byte order; a snapshot is meant for the machine that wrote it.
+// The file is mapped on load, so a restart copies records straight into the indexes.
+class SnapshotHandler {
+public:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::uint64_t count;
+        std::uint64_t lsn;        // last journal record contained in the image
+        std::uint64_t created_at; // unix seconds
+        std::uint64_t checksum;   // of the record area
+        std::uint64_t reserved[2];
+    };
+
+    static_assert(sizeof(Header) == 64);
+
+    // Consistent copy of the repository, written out later without any lock held
+    struct Image {
+        std::vector<Todo> todos;
+        WriteAheadLog::Mark mark{};
+    };
+
+    // Cuts the repository at one journal position and copies it without blocking writers:
+    // every shard is shared only long enough to pin its published time index and read the
+    // journal mark, then the pinned versions (which no writer changes) are copied lock-free.
+    // Runs on the thread that writes the snapshot, not on a request thread.
+    static Image capture(WriteAheadLog *journal) {
+        const InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
+        Image image;
+        EpochGuard pin;
+        std::vector<decltype(repo.shards_[0].by_time.view())> views;
+        views.reserve(repo.shard_count());
+        {
+            auto locks = repo.share_all();
+            for (std::size_t i = 0; i < repo.shard_count(); ++i) views.push_back(repo.shards_[i].by_time.view());
+            if (journal) image.mark = journal->mark();
+        }
+
+        std::size_t total = 0;
+        for (const auto &view: views) total += view.size();
+        image.todos.reserve(total);
+        std::vector<std::size_t> runs{0};
+        runs.reserve(views.size() + 1);
+        for (const auto &view: views) {
+            image.todos.insert(image.todos.end(), view.begin(), view.end());
+            runs.push_back(image.todos.size());
+        }
+
+        InMemoryTodoRepository::merge_runs(image.todos, runs);
+        return image;
+    }
+
+    // Writes path.tmp, syncs it and renames it over path, so a crash leaves the old snapshot intact
+    static void write(const std::string &path, const Image &image) {
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.record_size = sizeof(Todo);
+        header.count = image.todos.size();
+        header.lsn = image.mark.lsn;
+        header.created_at = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count());
+        header.checksum = checksum(reinterpret_cast<const char *>(image.todos.data()),
+                                   image.todos.size() * sizeof(Todo));
+
+        const std::string tmp = path + ".tmp";
+        const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "open " + tmp);
+        try {
+            write_all(fd, reinterpret_cast<const char *>(&header), sizeof(header), tmp);
+            write_all(fd, reinterpret_cast<const char *>(image.todos.data()), image.todos.size() * sizeof(Todo), tmp);
+            if (::fsync(fd) != 0) throw std::system_error(errno, std::generic_category(), "fsync " + tmp);
+        } catch (...) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            throw;
+        }
+        ::close(fd);
+
+        if (::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::system_error(errno, std::generic_category(), "rename " + tmp);
+        WriteAheadLog::sync_parent(path);
+    }
+
+    // Replaces the repository with the snapshot at path. Returns the journal lsn it covers,
+    // or 0 when there is no snapshot. Run before the journal is attached.
+    static std::uint64_t load(const std::string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT) return 0;
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::system_error(errno, std::generic_category(), "stat " + path);
+        }
+        const auto file_size = static_cast<std::size_t>(st.st_size);
+        if (file_size < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Snapshot too short: " + path);
+        }
+
+        void *mapped = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap " + path);
+        ::madvise(mapped, file_size, MADV_SEQUENTIAL);
+
+        struct Unmap {
+            void *p;
+            std::size_t n;
+
+            ~Unmap() { ::munmap(p, n); }
+        } unmap{mapped, file_size};
+
+        const auto *base = static_cast<const char *>(mapped);
+        Header header{};
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+            throw std::runtime_error("Not a snapshot: " + path);
+        const bool legacy = header.version == 1 && header.record_size == legacy_todo_size;
+        if (!legacy && (header.version != version || header.record_size != sizeof(Todo)))
+            throw std::runtime_error("Unsupported snapshot version: " + path);
+        if (header.count > (file_size - sizeof(Header)) / header.record_size)
+            throw std::runtime_error("Truncated snapshot: " + path);
+
+        const char *records = base + sizeof(Header);
+        if (checksum(records, header.count * header.record_size) != header.checksum)
+            throw std::runtime_error("Snapshot checksum mismatch: " + path);
+
+        if (legacy) {
+            std::vector<Todo> todos(static_cast<std::size_t>(header.count));
+            for (std::size_t i = 0; i < todos.size(); ++i) {
+                std::memcpy(static_cast<void *>(&todos[i]), records + i * legacy_todo_size, legacy_todo_size);
+            }
+            bulk_load(todos.data(), todos.size());
+            return header.lsn;
+        }
+
+        // records follow the header at offset 64, so they are suitably aligned in the mapping
+        const auto *todos = reinterpret_cast<const Todo *>(records);
+        bulk_load(todos, static_cast<std::size_t>(header.count));
+        return header.lsn;
+    }
+
+private:
+    static constexpr char magic[9] = "TODOSNAP";
+    static constexpr std::uint32_t version = 2;
+
+    // Buckets the time-sorted records by shard (each bucket stays sorted), then fills
+    // the shards in parallel: one reserve, then appends into every index.
+    static void bulk_load(const Todo *todos, std::size_t count) {
+        InMemoryTodoRepository &repo = InMemoryTodoRepository::instance();
+        repo.clear();
+
+        std::vector<std::vector<const Todo *>> buckets(repo.shard_count());
+        for (auto &bucket: buckets) bucket.reserve(count / repo.shard_count() + 1);
+        for (std::size_t i = 0; i < count; ++i) {
+            buckets[repo.shard_index(todos[i].name)].push_back(&todos[i]);
+        }
+
+        const std::size_t workers = std::min<std::size_t>(
+                repo.shard_count(), std::max(1u, std::thread::hardware_concurrency()));
+        repo.for_each_shard(workers, [&](std::size_t, std::size_t s) {
+            auto &shard = repo.shards_[s];
+            std::unique_lock lock(shard.mutex);
+
+            auto publish = shard.batch();
+
+            std::vector<Todo> run;
+            std::vector<TodoPriorityKey> prioritized;
+            std::vector<TodoTagKey> tagged;
+            run.reserve(buckets[s].size());
+            shard.by_name.reserve(buckets[s].size());
+            for (const Todo *todo: buckets[s]) {
+                if (!shard.by_name.try_emplace(todo->name, todo->details()).second) {
+                    throw std::runtime_error("Snapshot contains a duplicate name");
+                }
+                run.push_back(*todo);
+                if (todo->priority) prioritized.push_back(InMemoryTodoRepository::priority_key(*todo));
+                InMemoryTodoRepository::for_each_tag_key(*todo, [&](const TodoTagKey &key) { tagged.push_back(key); });
+            }
+            shard.by_time.insert_sorted(run.begin(), run.end());
+            std::sort(run.begin(), run.end(), TodoNameLess{});
+            const auto names = run | std::views::transform(&Todo::name);
+            shard.by_name_order.insert_sorted(names.begin(), names.end());
+            std::sort(prioritized.begin(), prioritized.end(), TodoPriorityLess{});
+            shard.by_priority.insert_sorted(prioritized.begin(), prioritized.end());
+            std::sort(tagged.begin(), tagged.end(), TodoTagLess{});
+            shard.by_tag.insert_sorted(tagged.begin(), tagged.end());
+        });
+        repo.changes_.record(ChangeLog::Kind::resync);
+        repo.changed();
+    }
+
+    // multiply-rotate over 64-bit words; cheap enough to verify gigabytes at memory speed
+    static std::uint64_t checksum(const char *data, std::size_t size) noexcept {
+        std::uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+        std::size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            h = std::rotl((h ^ word) * 0xFF51AFD7ED558CCDull, 29);
+        }
+        for (; i < size; ++i) {
+            h = std::rotl((h ^ static_cast<unsigned char>(data[i])) * 0xC4CEB9FE1A85EC53ull, 11);
+        }
+        return h ^ (h >> 33);
+    }
+
+    static void write_all(int fd, const char *data, std::size_t size, const std::string &path) {
+        while (size > 0) {
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "write " + path);
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+};
@@ -0,0 +1,521 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+#include <system_error>
+#include <boost/crc.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../../Entity/Todo.hpp"
+
+// Thrown once the journal has failed: no later write can be made durable
+class JournalFailed : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Append-only binary journal of repository mutations.
+//
+// File layout: "TODOWAL1", then records of
+//   [u32 payload size][u32 crc32 of lsn..payload][u64 lsn][u8 op][payload]
+// Records are appended to an in-memory buffer under the caller's lock and written out
+// in batches: every concurrent writer waiting on commit() shares one write + fdatasync.
+class WriteAheadLog {
+public:
+    enum class Op : std::uint8_t {
+        add = 1,          // Todo (72 bytes, without priority and tags, in older logs)
+        erase = 2,        // name
+        erase_before = 3, // u64 timestamp
+        batch_add = 4,    // u32 count, count * Todo
+        clear = 5,        // -
+    };
+
+    enum class SyncPolicy {
+        always,   // commit() returns once the record is on disk (group commit)
+        interval, // a flusher writes and fdatasyncs every `interval`
+        none,     // a flusher writes every `interval`, the OS decides when to sync
+    };
+
+    struct Options {
+        std::string path;
+        SyncPolicy policy = SyncPolicy::interval;
+        std::chrono::milliseconds interval{10};
+    };
+
+    static SyncPolicy parse_policy(std::string_view name) {
+        if (name == "always") return SyncPolicy::always;
+        if (name == "interval") return SyncPolicy::interval;
+        if (name == "none") return SyncPolicy::none;
+        throw std::invalid_argument("Unknown WAL sync policy: " + std::string(name));
+    }
+
+    struct Record {
+        std::uint64_t lsn;
+        Op op;
+        std::string_view payload;
+    };
+
+    // Reads every intact record of the log at `path` and truncates a torn tail.
+    // Returns the last lsn seen (0 for a missing or empty log).
+    template<typename Apply>
+    static std::uint64_t replay(const std::string &path, Apply &&apply) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+
+        std::string data;
+        struct stat st{};
+        if (::fstat(fd, &st) == 0) data.resize(static_cast<std::size_t>(st.st_size));
+        std::size_t got = 0;
+        while (got < data.size()) {
+            const ssize_t n = ::read(fd, data.data() + got, data.size() - got);
+            if (n <= 0) break;
+            got += static_cast<std::size_t>(n);
+        }
+        ::close(fd);
+        data.resize(got);
+
+        // a crash while the magic was written leaves part of it; start the log over
+        if (data.size() < magic.size() && magic.starts_with(data)) {
+            if (!data.empty() && ::truncate(path.c_str(), 0) != 0) {
+                throw std::system_error(errno, std::generic_category(), "truncate " + path);
+            }
+            return 0;
+        }
+        if (std::string_view(data).substr(0, magic.size()) != magic)
+            throw std::runtime_error("Not a write-ahead log: " + path);
+
+        std::uint64_t last_lsn = 0;
+        std::size_t pos = magic.size();
+        while (data.size() - pos >= header_size) {
+            const char *h = data.data() + pos;
+            const auto size = load<std::uint32_t>(h);
+            const auto crc = load<std::uint32_t>(h + 4);
+            if (data.size() - pos - header_size < size) break;
+            if (checksum(h + 8, 9 + size) != crc) break;
+
+            Record record{load<std::uint64_t>(h + 8), static_cast<Op>(h[16]), {h + header_size, size}};
+            apply(record);
+            last_lsn = record.lsn;
+            pos += header_size + size;
+        }
+
+        if (pos < data.size()) {
+            std::cerr << "WAL: dropping " << data.size() - pos << " bytes of torn tail in " << path << std::endl;
+            if (::truncate(path.c_str(), static_cast<off_t>(pos)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "truncate " + path);
+            }
+        }
+        return last_lsn;
+    }
+
+    // Position in the log: every record up to `lsn` ends before byte `offset`
+    struct Mark {
+        std::uint64_t lsn;
+        std::uint64_t offset;
+    };
+
+    WriteAheadLog(Options options, std::uint64_t last_lsn)
+            : options_(std::move(options)), next_lsn_(last_lsn + 1), durable_lsn_(last_lsn) {
+        open_file();
+
+        if (options_.policy != SyncPolicy::always) {
+            flusher_ = std::thread([this] { flush_loop(); });
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (flusher_.joinable()) flusher_.join();
+        try {
+            flush(true);
+        } catch (const std::exception &e) {
+            std::cerr << "WAL: final flush failed: " << e.what() << std::endl;
+        }
+        ::close(fd_);
+    }
+
+    // Appends one record to the pending buffer and returns its lsn.
+    // Callers hold the lock that orders the mutation, so the log order is the apply order.
+    std::uint64_t append(Op op, std::string_view payload) {
+        std::lock_guard lock(mutex_);
+        const std::uint64_t lsn = next_lsn_++;
+        if (!failed_.empty()) return lsn; // never written, its commit() throws
+
+        char header[header_size];
+        store(header, static_cast<std::uint32_t>(payload.size()));
+        store(header + 8, lsn);
+        header[16] = static_cast<char>(op);
+
+        boost::crc_32_type crc;
+        crc.process_bytes(header + 8, 9);
+        crc.process_bytes(payload.data(), payload.size());
+        store(header + 4, static_cast<std::uint32_t>(crc.checksum()));
+
+        pending_.append(header, header_size);
+        pending_.append(payload);
+        appended_lsn_ = lsn;
+        return lsn;
+    }
+
+    std::uint64_t append_add(const Todo &todo) {
+        return append(Op::add, {reinterpret_cast<const char *>(&todo), sizeof(Todo)});
+    }
+
+    std::uint64_t append_erase(const jh::pod::array<char, 64> &name) {
+        return append(Op::erase, {name.data, jh::pod::array<char, 64>::size()});
+    }
+
+    std::uint64_t append_erase_before(std::uint64_t timestamp) {
+        return append(Op::erase_before, {reinterpret_cast<const char *>(&timestamp), sizeof(timestamp)});
+    }
+
+    std::uint64_t append_clear() {
+        return append(Op::clear, {});
+    }
+
+    template<typename Container>
+    std::uint64_t append_batch(const Container &todos) {
+        std::string payload;
+        payload.resize(sizeof(std::uint32_t) + todos.size() * sizeof(Todo));
+        store(payload.data(), static_cast<std::uint32_t>(todos.size()));
+        char *out = payload.data() + sizeof(std::uint32_t);
+        for (const Todo &todo: todos) {
+            std::memcpy(out, &todo, sizeof(Todo));
+            out += sizeof(Todo);
+        }
+        return append(Op::batch_add, payload);
+    }
+
+    // Waits until `lsn` is durable under the always policy; otherwise the flusher takes it.
+    // Throws once the log has failed, see fail().
+    void commit(std::uint64_t lsn) {
+        std::unique_lock lock(mutex_);
+        check_failed();
+        if (options_.policy != SyncPolicy::always) return;
+
+        while (durable_lsn_ < lsn) {
+            check_failed();
+            if (flushing_) {
+                flushed_.wait(lock);
+                continue;
+            }
+            flush_locked(lock, true);
+        }
+    }
+
+    // Throws once the log has failed. The store checks it under the shard lock before it applies
+    // a write, so a write the log can no longer keep is refused instead of lost on restart.
+    void check_writable() const {
+        if (broken_.load(std::memory_order_acquire)) throw JournalFailed("WAL: journal failed: " + failed_);
+    }
+
+    bool failed() const noexcept {
+        return broken_.load(std::memory_order_acquire);
+    }
+
+    // Writes everything appended so far, with fdatasync when `durable`.
+    void flush(bool durable) {
+        std::unique_lock lock(mutex_);
+        while (flushing_) flushed_.wait(lock);
+        check_failed();
+        if (durable_lsn_ < appended_lsn_ || !pending_.empty()) flush_locked(lock, durable);
+    }
+
+    // Current end of the log. Taken while mutations are blocked, it marks a consistent cut.
+    Mark mark() {
+        std::lock_guard lock(mutex_);
+        return {next_lsn_ - 1, file_bytes_ + inflight_bytes_ + pending_.size()};
+    }
+
+    // Drops every record before `cut` once a snapshot covers them: the records after the
+    // cut are copied into a fresh file that atomically replaces the log. The copy runs with
+    // the mutex released, so appends (made under shard locks) never wait for it: first the
+    // tail as it stands, then, with flushes held back, whatever was flushed meanwhile.
+    void compact(const Mark &cut) {
+        std::unique_lock lock(mutex_);
+        while (flushing_) flushed_.wait(lock);
+        check_failed();
+        if (!pending_.empty()) flush_locked(lock, false);
+        if (cut.offset <= magic.size() || cut.offset > file_bytes_) return;
+        const std::uint64_t copied = file_bytes_;
+        lock.unlock();
+
+        const std::string tmp = options_.path + ".tmp";
+        const int in = ::open(options_.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) throw std::system_error(errno, std::generic_category(), "open " + options_.path);
+        const int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (out < 0) {
+            ::close(in);
+            throw std::system_error(errno, std::generic_category(), "open " + tmp);
+        }
+
+        bool holding = false; // flushes held back by claiming the flusher role
+        std::uint64_t end = copied;
+        try {
+            write_fd(out, magic, tmp);
+            copy_range(in, cut.offset, copied, out, tmp);
+
+            lock.lock();
+            while (flushing_) flushed_.wait(lock);
+            flushing_ = holding = true;
+            end = file_bytes_;
+            lock.unlock();
+
+            copy_range(in, copied, end, out, tmp);
+            sync_fd(out, tmp);
+            if (::rename(tmp.c_str(), options_.path.c_str()) != 0)
+                throw std::system_error(errno, std::generic_category(), "rename " + tmp);
+        } catch (...) {
+            ::close(in);
+            ::close(out);
+            ::unlink(tmp.c_str());
+            if (holding) {
+                lock.lock();
+                flushing_ = false;
+                flushed_.notify_all();
+            }
+            throw;
+        }
+        ::close(in);
+        sync_parent(options_.path); // the new file must not be lost once appends go to it
+
+        lock.lock();
+        ::close(fd_);
+        fd_ = out;
+        file_bytes_ = magic.size() + end - cut.offset;
+        flushing_ = false;
+        flushed_.notify_all();
+    }
+
+    // Makes a rename into the directory of `path` durable (shared with SnapshotHandler)
+    static void sync_parent(const std::string &path) {
+        const auto slash = path.rfind('/');
+        const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        ::fsync(fd);
+        ::close(fd);
+    }
+
+    // Decodes a batch_add payload.
+    static std::vector<Todo> decode_batch(std::string_view payload) {
+        if (payload.size() < sizeof(std::uint32_t)) throw std::runtime_error("WAL: short batch record");
+        const auto count = load<std::uint32_t>(payload.data());
+        const std::size_t records = payload.size() - sizeof(std::uint32_t);
+        std::vector<Todo> todos(count);
+        if (records == std::size_t{count} * sizeof(Todo)) {
+            std::memcpy(todos.data(), payload.data() + sizeof(std::uint32_t), records);
+        } else if (records == std::size_t{count} * legacy_todo_size) {
+            for (std::size_t i = 0; i < count; ++i) {
+                std::memcpy(static_cast<void *>(&todos[i]), payload.data() + sizeof(std::uint32_t) + i * legacy_todo_size, legacy_todo_size);
+            }
+        } else {
+            throw std::runtime_error("WAL: malformed batch record");
+        }
+        return todos;
+    }
+
+    // Decodes an add payload; logs written before priority and tags hold shorter records
+    static Todo decode_todo(std::string_view payload) {
+        if (payload.size() != sizeof(Todo) && payload.size() != legacy_todo_size)
+            throw std::runtime_error("WAL: malformed record");
+        Todo todo;
+        std::memcpy(static_cast<void *>(&todo), payload.data(), payload.size());
+        return todo;
+    }
+
+    template<typename T>
+    static T decode(std::string_view payload) {
+        if (payload.size() != sizeof(T)) throw std::runtime_error("WAL: malformed record");
+        return load<T>(payload.data());
+    }
+
+private:
+    static constexpr std::string_view magic = "TODOWAL1";
+    static constexpr std::size_t header_size = 17;
+    static constexpr std::size_t copy_chunk = std::size_t{1} << 20; // compaction copies the tail this much at a time
+
+    Options options_;
+    int fd_ = -1;
+    std::uint64_t file_bytes_ = 0;     // bytes in the file
+    std::uint64_t inflight_bytes_ = 0; // bytes being written by the current flush
+
+    std::mutex mutex_;
+    std::condition_variable flushed_; // a flush finished
+    std::condition_variable wake_;    // flusher stop request
+    std::string pending_;
+    std::uint64_t next_lsn_;
+    std::uint64_t appended_lsn_ = 0;
+    std::uint64_t durable_lsn_;
+    bool flushing_ = false;
+    bool stopping_ = false;
+    std::string failed_; // why the log stopped accepting commits, see fail()
+    std::atomic<bool> broken_{false}; // failed_ is set; read without the mutex
+    std::thread flusher_;
+
+    template<typename T>
+    static T load(const char *p) noexcept {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    }
+
+    template<typename T>
+    static void store(char *p, T v) noexcept {
+        std::memcpy(p, &v, sizeof(T));
+    }
+
+    static std::uint32_t checksum(const char *p, std::size_t n) {
+        boost::crc_32_type crc;
+        crc.process_bytes(p, n);
+        return static_cast<std::uint32_t>(crc.checksum());
+    }
+
+    // Leader step of the group commit: takes the whole pending buffer, writes it with the
+    // lock released (new appends keep filling a fresh buffer), then wakes every waiter.
+    void flush_locked(std::unique_lock<std::mutex> &lock, bool durable) {
+        flushing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        const std::uint64_t target = appended_lsn_;
+        inflight_bytes_ = batch.size();
+        lock.unlock();
+
+        bool written = false;
+        try {
+            write_all(batch);
+            written = true;
+            if (durable) sync();
+        } catch (const std::exception &e) {
+            lock.lock();
+            rollback(batch, e, written);
+            inflight_bytes_ = 0;
+            flushing_ = false;
+            flushed_.notify_all();
+            throw;
+        }
+
+        lock.lock();
+        file_bytes_ += inflight_bytes_;
+        inflight_bytes_ = 0;
+        durable_lsn_ = std::max(durable_lsn_, target);
+        flushing_ = false;
+        flushed_.notify_all();
+    }
+
+    // A failed flush leaves no record behind that is not durable: the file is cut back to
+    // its last good end and the batch goes back in front of the pending records, so a later
+    // flush writes it again. A failed fdatasync (or cut) cannot be retried: the kernel may have
+    // dropped the dirty pages already, and a later sync would report them as written.
+    void rollback(const std::string &batch, const std::exception &error, bool sync_failed) {
+        pending_.insert(0, batch);
+        if (::ftruncate(fd_, static_cast<off_t>(file_bytes_)) != 0) {
+            fail("truncate " + options_.path + " after " + error.what());
+        } else if (sync_failed) {
+            fail(error.what());
+        }
+    }
+
+    // Latches the failure: every later commit() throws, since what it waits for can no longer
+    // be made durable, and the store refuses writes (check_writable). Reads keep being served;
+    // restart to recover from the log.
+    void fail(const std::string &reason) {
+        if (failed_.empty()) {
+            failed_ = reason;
+            broken_.store(true, std::memory_order_release);
+            std::cerr << "WAL: journal failed, writes are refused from now on: " << reason << std::endl;
+        }
+    }
+
+    void check_failed() const {
+        if (!failed_.empty()) throw JournalFailed("WAL: journal failed: " + failed_);
+    }
+
+    void flush_loop() {
+        std::unique_lock lock(mutex_);
+        while (!stopping_) {
+            wake_.wait_for(lock, options_.interval, [this] { return stopping_; });
+            if (stopping_ || flushing_ || pending_.empty() || !failed_.empty()) continue;
+            try {
+                flush_locked(lock, options_.policy == SyncPolicy::interval);
+            } catch (const std::exception &e) {
+                std::cerr << "WAL: flush failed: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void open_file() {
+        fd_ = ::open(options_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "open " + options_.path);
+
+        struct stat st{};
+        if (::fstat(fd_, &st) != 0) throw std::system_error(errno, std::generic_category(), "stat " + options_.path);
+        file_bytes_ = static_cast<std::uint64_t>(st.st_size);
+        if (file_bytes_ == 0) {
+            write_all(magic);
+            sync();
+            file_bytes_ = magic.size();
+        }
+    }
+
+    void write_all(std::string_view data) {
+        write_fd(fd_, data, options_.path);
+    }
+
+    void sync() {
+        sync_fd(fd_, options_.path);
+    }
+
+    static void write_fd(int fd, std::string_view data, const std::string &path) {
+        while (!data.empty()) {
+            const ssize_t n = ::write(fd, data.data(), data.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "write " + path);
+            }
+            data.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+
+    // appends bytes [from, to) of in to out
+    static void copy_range(int in, std::uint64_t from, std::uint64_t to, int out, const std::string &path) {
+        std::string chunk(static_cast<std::size_t>(std::min<std::uint64_t>(to - from, copy_chunk)), '\0');
+        while (from < to) {
+            const auto want = static_cast<std::size_t>(std::min<std::uint64_t>(to - from, chunk.size()));
+            const ssize_t n = ::pread(in, chunk.data(), want, static_cast<off_t>(from));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("WAL: short read while compacting");
+            write_fd(out, {chunk.data(), static_cast<std::size_t>(n)}, path);
+            from += static_cast<std::uint64_t>(n);
+        }
+    }
+
+    static void sync_fd(int fd, const std::string &path) {
+#if defined(__APPLE__)
+        const int rc = ::fsync(fd);
+#else
+        const int rc = ::fdatasync(fd);
+#endif
+        if (rc != 0) throw std::system_error(errno, std::generic_category(), "fdatasync " + path);
+    }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <boost/beast/core/string.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HttpUtils.hpp"
+
+// Content-Encoding negotiation and deflate for responses. zlib streams are pooled per
+// thread and reset between responses instead of being set up (256 KiB each) per request.
+namespace compression {
+    namespace http = http_util::http;
+
+    enum class Encoding { identity, gzip, deflate };
+
+    struct Settings {
+        std::size_t min_bytes = 1024; // smaller bodies are sent as they are
+        int level = 1;                // zlib level, 1 fastest .. 9 smallest; 0 turns compression off
+    };
+
+    inline const char *name(Encoding encoding) {
+        switch (encoding) {
+            case Encoding::gzip: return "gzip";
+            case Encoding::deflate: return "deflate";
+            case Encoding::identity: break;
+        }
+        return "identity";
+    }
+
+    // Best of gzip / deflate by the q-values of Accept-Encoding (gzip on a tie), else identity
+    inline Encoding negotiate(std::string_view accept_encoding) {
+        auto trim = [](std::string_view s) {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+            return s;
+        };
+
+        double gzip = -1, deflate = -1, any = -1;
+        while (!accept_encoding.empty()) {
+            const auto comma = accept_encoding.find(',');
+            const std::string_view item = accept_encoding.substr(0, comma);
+            accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+            const auto semi = item.find(';');
+            const std::string_view coding = trim(item.substr(0, semi));
+            double q = 1;
+            if (semi != std::string_view::npos) {
+                const std::string_view param = trim(item.substr(semi + 1));
+                if (param.starts_with("q=") || param.starts_with("Q=")) {
+                    std::from_chars(param.data() + 2, param.data() + param.size(), q);
+                }
+            }
+
+            if (boost::beast::iequals(coding, "gzip") || boost::beast::iequals(coding, "x-gzip")) gzip = q;
+            else if (boost::beast::iequals(coding, "deflate")) deflate = q;
+            else if (coding == "*") any = q;
+        }
+        if (gzip < 0) gzip = any;
+        if (deflate < 0) deflate = any;
+        if (gzip <= 0 && deflate <= 0) return Encoding::identity;
+        return gzip >= deflate ? Encoding::gzip : Encoding::deflate;
+    }
+
+    class Deflater {
+    public:
+        Deflater(Encoding encoding, int level) : encoding_(encoding), level_(level) {
+            // window bits + 16 writes the gzip header and trailer, plain 15 the zlib wrapper
+            if (deflateInit2(&z_, level, Z_DEFLATED, encoding == Encoding::gzip ? 15 + 16 : 15, 8,
+                             Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::bad_alloc();
+            }
+        }
+
+        ~Deflater() {
+            deflateEnd(&z_);
+        }
+
+        Deflater(const Deflater &) = delete;
+        Deflater &operator=(const Deflater &) = delete;
+
+        Encoding encoding() const noexcept { return encoding_; }
+
+        int level() const noexcept { return level_; }
+
+        // appends the compressed form of in to out; finish ends the stream
+        template<typename String>
+        void write(std::string_view in, String &out, bool finish) {
+            for (;;) {
+                const std::size_t take = std::min(in.size(), max_slice);
+                const int flush = finish && take == in.size() ? Z_FINISH : Z_NO_FLUSH;
+                z_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+                z_.avail_in = static_cast<uInt>(take);
+
+                int rc;
+                do {
+                    const std::size_t start = out.size();
+                    const std::size_t room = std::max<std::size_t>(deflateBound(&z_, z_.avail_in), 4096);
+                    out.resize(start + room);
+                    z_.next_out = reinterpret_cast<Bytef *>(out.data() + start);
+                    z_.avail_out = static_cast<uInt>(room);
+                    rc = deflate(&z_, flush);
+                    out.resize(out.size() - z_.avail_out);
+                    if (rc == Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+                } while (z_.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+
+                in.remove_prefix(take);
+                if (in.empty()) return;
+            }
+        }
+
+        void reset() noexcept {
+            deflateReset(&z_);
+        }
+
+    private:
+        static constexpr std::size_t max_slice = std::size_t{1} << 30; // avail_in is 32 bits
+
+        z_stream z_{};
+        Encoding encoding_;
+        int level_;
+    };
+
+    // Deflaters ready for reuse on this thread
+    inline std::vector<std::unique_ptr<Deflater>> &thread_pool() {
+        thread_local std::vector<std::unique_ptr<Deflater>> pool;
+        return pool;
+    }
+
+    // A reset deflater from the calling thread's pool. A streamed body keeps its handle across
+    // writes, possibly on other threads: it joins the pool of the thread that drops it.
+    inline std::shared_ptr<Deflater> acquire(Encoding encoding, int level) {
+        constexpr std::size_t max_pooled = 8;
+        auto &pool = thread_pool();
+        auto it = std::find_if(pool.begin(), pool.end(), [&](const auto &d) {
+            return d->encoding() == encoding && d->level() == level;
+        });
+
+        std::unique_ptr<Deflater> deflater;
+        if (it != pool.end()) {
+            deflater = std::move(*it);
+            pool.erase(it);
+        } else {
+            deflater = std::make_unique<Deflater>(encoding, level);
+        }
+        return {deflater.release(), [](Deflater *d) {
+            d->reset();
+            auto &pool = thread_pool();
+            if (pool.size() < max_pooled) pool.emplace_back(d);
+            else delete d;
+        }};
+    }
+
+    // Coded forms of shared bodies. Those come from ResponseCache and never change, so each
+    // is compressed once per encoding rather than on every response that sends it.
+    class CodedBodies {
+    public:
+        static CodedBodies &instance() {
+            static CodedBodies bodies;
+            return bodies;
+        }
+
+        std::shared_ptr<const std::string> find(const std::shared_ptr<const std::string> &source, Encoding encoding,
+                                                int level) const {
+            std::lock_guard lock(mutex_);
+            for (const Slot &slot: slots_) {
+                if (slot.encoding == encoding && slot.level == level && same(slot.source, source)) return slot.coded;
+            }
+            return nullptr;
+        }
+
+        void store(const std::shared_ptr<const std::string> &source, Encoding encoding, int level,
+                   std::shared_ptr<const std::string> coded) {
+            std::lock_guard lock(mutex_);
+            slots_[next_] = {source, encoding, level, std::move(coded)};
+            next_ = (next_ + 1) % slots_.size();
+        }
+
+    private:
+        struct Slot {
+            std::weak_ptr<const std::string> source;
+            Encoding encoding = Encoding::identity;
+            int level = 0;
+            std::shared_ptr<const std::string> coded;
+        };
+
+        mutable std::mutex mutex_;
+        std::array<Slot, 4> slots_; // two cached kinds in two encodings, replaced round robin
+        std::size_t next_ = 0;
+
+        static bool same(const std::weak_ptr<const std::string> &a, const std::shared_ptr<const std::string> &b) {
+            return !a.owner_before(b) && !b.owner_before(a);
+        }
+    };
+
+    inline bool compressible(std::string_view content_type) {
+        return content_type.starts_with("text/") || content_type.starts_with("application/json");
+    }
+
+    // Compresses a text / JSON response when the client accepts it: buffered bodies of at
+    // least min_bytes at once, streamed bodies chunk by chunk as they are produced.
+    inline void apply(const http_util::Request &req, http_util::Response &res, const Settings &settings) {
+        if (settings.level <= 0 || req.method() == http::verb::head) return;
+        const unsigned status = res.result_int();
+        if (status < 200 || status == 204 || status == 304) return;
+        if (res.count(http::field::content_encoding) || !compressible(res[http::field::content_type])) return;
+
+        res.set(http::field::vary, "Accept-Encoding");
+        auto &body = res.body();
+        const bool streamed = static_cast<bool>(body.producer);
+        if (!streamed && http_util::StreamBody::size(body) < settings.min_bytes) return;
+
+        const Encoding encoding = negotiate(req[http::field::accept_encoding]);
+        if (encoding == Encoding::identity) return;
+
+        if (streamed) {
+            body.producer = [inner = std::move(body.producer), deflater = acquire(encoding, settings.level),
+                             raw = std::string()](std::string &chunk) mutable {
+                raw.clear();
+                const bool more = inner(raw);
+                deflater->write(raw, chunk, !more);
+                return more;
+            };
+        } else if (body.shared) {
+            auto &coded_bodies = CodedBodies::instance();
+            auto coded = coded_bodies.find(body.shared, encoding, settings.level);
+            if (!coded) {
+                std::string out;
+                acquire(encoding, settings.level)->write(*body.shared, out, true);
+                coded = std::make_shared<const std::string>(std::move(out));
+                coded_bodies.store(body.shared, encoding, settings.level, coded);
+            }
+            body.shared = std::move(coded);
+        } else {
+            std::pmr::string out(body.data.get_allocator());
+            acquire(encoding, settings.level)->write(body.data, out, true);
+            body.data = std::move(out);
+        }
+
+        res.set(http::field::content_encoding, name(encoding));
+        // the coded bytes differ from the identity ones: the validator can only stay weak
+        const std::string_view etag = res[http::field::etag];
+        if (etag.starts_with('"')) res.set(http::field::etag, "W/" + std::string(etag));
+        if (!streamed) res.prepare_payload();
+    }
+}
@@ -0,0 +1,251 @@
+#pragma once
+#include <boost/beast/http.hpp>
+#include <boost/asio/buffer.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include "HttpUtils.hpp"
+#include "../Application/TodoManager.hpp"
+
+// Request body type for a CSV upload to /todo_import: the body is never held in memory as a
+// whole. The reader only copies it into blocks, which a worker thread parses while the rest
+// arrives; the store is changed once the whole body has parsed. A parse error is recorded
+// and the rest of the body is drained, so the view can answer 400 with the store untouched.
+struct CsvImportBody {
+    // The parsing side of one upload, on its own thread like a checkpoint. The io thread
+    // submit()s blocks and close()s; backlogged() and when_done() call back from the worker.
+    class Job {
+    public:
+        static constexpr std::size_t block_size = std::size_t{4} << 20;   // bytes per submitted block
+        static constexpr std::size_t max_backlog = std::size_t{16} << 20; // submitted but unparsed, before reading pauses
+
+        explicit Job(bool clear_before) : importer_(TodoManager::csv_importer(clear_before)) {
+            try {
+                worker_ = std::thread([this] { run(); });
+            } catch (const std::exception &e) {
+                error_ = e.what();
+                done_ = true;
+            }
+        }
+
+        // an unfinished upload (connection lost) is dropped without touching the store
+        ~Job() {
+            {
+                std::lock_guard lock(mutex_);
+                abandoned_ = true;
+            }
+            wake_.notify_all();
+            if (worker_.joinable()) worker_.join();
+        }
+
+        Job(const Job &) = delete;
+        Job &operator=(const Job &) = delete;
+
+        void submit(std::string block) {
+            if (block.empty()) return;
+            {
+                std::lock_guard lock(mutex_);
+                backlog_ += block.size();
+                blocks_.push_back(std::move(block));
+            }
+            wake_.notify_all();
+        }
+
+        // the body is complete: parse what is left, then apply it
+        void close() {
+            {
+                std::lock_guard lock(mutex_);
+                closed_ = true;
+            }
+            wake_.notify_all();
+        }
+
+        // False while there is room for more blocks; otherwise resume is called once the
+        // worker has caught up
+        bool backlogged(std::function<void()> resume) {
+            std::lock_guard lock(mutex_);
+            if (backlog_ <= max_backlog || done_) return false;
+            resume_ = std::move(resume);
+            hold();
+            return true;
+        }
+
+        // Calls done once the import has finished (at once if it already has)
+        void when_done(std::function<void()> done) {
+            std::unique_lock lock(mutex_);
+            if (!done_) {
+                done_callback_ = std::move(done);
+                hold();
+                return;
+            }
+            lock.unlock();
+            done();
+        }
+
+        // results, once done
+        std::size_t rows() const noexcept { return rows_; }
+
+        const std::string &error() const noexcept { return error_; }
+
+        // the store refused the rows: the journal has failed
+        bool journal_failed() const noexcept { return journal_failed_; }
+
+        // Waits until no worker still owes a callback; at shutdown, before the io contexts go
+        static void drain() {
+            auto &callbacks = pending_callbacks();
+            std::unique_lock lock(callbacks.mutex);
+            callbacks.idle.wait(lock, [&] { return callbacks.count == 0; });
+        }
+
+    private:
+        struct Callbacks {
+            std::mutex mutex;
+            std::condition_variable idle;
+            std::size_t count = 0;
+        };
+
+        CsvImporter importer_;
+        std::thread worker_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::deque<std::string> blocks_;
+        std::size_t backlog_ = 0;
+        bool closed_ = false;
+        bool abandoned_ = false;
+        bool done_ = false;
+        std::function<void()> resume_;
+        std::function<void()> done_callback_;
+        std::size_t rows_ = 0;
+        std::string error_;
+        bool journal_failed_ = false;
+
+        static Callbacks &pending_callbacks() {
+            static Callbacks callbacks;
+            return callbacks;
+        }
+
+        static void hold() {
+            std::lock_guard lock(pending_callbacks().mutex);
+            ++pending_callbacks().count;
+        }
+
+        static void release() {
+            std::lock_guard lock(pending_callbacks().mutex);
+            if (--pending_callbacks().count == 0) pending_callbacks().idle.notify_all();
+        }
+
+        void run() {
+            std::unique_lock lock(mutex_);
+            while (true) {
+                wake_.wait(lock, [this] { return abandoned_ || closed_ || !blocks_.empty(); });
+                if (abandoned_) return;
+                if (blocks_.empty()) break;
+
+                const std::string block = std::move(blocks_.front());
+                blocks_.pop_front();
+                lock.unlock();
+                // after the first error the rest of the body is only drained
+                if (error_.empty()) guarded([&] { importer_.feed(block); });
+                lock.lock();
+
+                backlog_ -= block.size();
+                if (resume_ && backlog_ <= max_backlog / 2) {
+                    auto resume = std::move(resume_);
+                    resume_ = nullptr;
+                    lock.unlock();
+                    resume();
+                    release();
+                    lock.lock();
+                }
+            }
+            lock.unlock();
+
+            if (error_.empty()) guarded([&] { rows_ = importer_.finish(); });
+
+            lock.lock();
+            done_ = true;
+            auto done = std::move(done_callback_);
+            done_callback_ = nullptr;
+            lock.unlock();
+            if (done) {
+                done();
+                release();
+            }
+        }
+
+        template<typename F>
+        void guarded(F &&f) {
+            try {
+                f();
+            } catch (const JournalFailed &e) {
+                error_ = e.what();
+                journal_failed_ = true;
+            } catch (const std::exception &e) {
+                error_ = e.what();
+            }
+        }
+    };
+
+    struct value_type {
+        std::unique_ptr<Job> job; // made by the session, which close()s it once the body is in
+        std::string block; // received, not yet submitted
+        std::chrono::steady_clock::time_point started;
+    };
+
+    class reader {
+    public:
+        template<bool isRequest, class Fields>
+        reader(boost::beast::http::header<isRequest, Fields> &, value_type &body) : body_(body) {}
+
+        void init(const boost::optional<std::uint64_t> &, boost::beast::error_code &ec) {
+            ec = {};
+            body_.block.reserve(Job::block_size);
+        }
+
+        template<class ConstBufferSequence>
+        std::size_t put(const ConstBufferSequence &buffers, boost::beast::error_code &ec) {
+            ec = {};
+            std::size_t size = 0;
+            for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+                const boost::asio::const_buffer buffer = *it;
+                body_.block.append(static_cast<const char *>(buffer.data()), buffer.size());
+                size += buffer.size();
+            }
+            if (body_.block.size() >= Job::block_size) {
+                body_.job->submit(std::move(body_.block));
+                body_.block = {};
+                body_.block.reserve(Job::block_size);
+            }
+            return size;
+        }
+
+        void finish(boost::beast::error_code &ec) {
+            ec = {};
+            body_.job->submit(std::move(body_.block));
+        }
+
+    private:
+        value_type &body_;
+    };
+
+    // a POST to /todo_import whose body is not JSON
+    template<class Fields>
+    static bool accepts(const boost::beast::http::request_header<Fields> &req) {
+        const std::string_view target = req.target();
+        return req.method() == boost::beast::http::verb::post
+               && target.substr(0, target.find('?')) == "/todo_import"
+               && !req[boost::beast::http::field::content_type].starts_with("application/json");
+    }
+
+    // `?clear_before=false` (or `0`) appends to the existing todos
+    static bool clear_before(std::string_view target) {
+        const auto value = http_util::query_param(target, "clear_before");
+        return !value || (*value != "false" && *value != "0");
+    }
+};
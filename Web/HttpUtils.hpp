@@ -1,30 +1,176 @@
 #pragma once
 #include <boost/beast/http.hpp>
+#include <boost/asio/buffer.hpp>
 #include <boost/json.hpp>
 #include <jh/pod>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "RequestArena.hpp"
 
 namespace http_util {
     namespace beast = boost::beast;
     namespace http = beast::http;
 
-    using Request  = http::request<http::string_body>;
-    using Response = http::response<http::string_body>;
+    // Messages allocate from the arena of their connection (see RequestArena), header
+    // fields and bodies alike; one built without an allocator uses the default heap
+    using Allocator = ArenaAllocator<char>;
+    using Fields = http::basic_fields<Allocator>;
+
+    // Set by a view that has nothing to answer yet (a long poll). The session holds the prepared
+    // response back for timeout, and runs the request again if subscribe's callback fires first.
+    struct Wait {
+        std::chrono::steady_clock::duration timeout;
+        std::function<std::uint64_t(std::function<void()>)> subscribe; // returns an id for unsubscribe
+        std::function<void(std::uint64_t)> unsubscribe;
+        std::string target; // when set, the request runs again with this target (pins what the first run resolved)
+    };
+
+    // Response body: a string, a string shared with a cache (sent without a copy), or a
+    // producer that appends one chunk per call (returning false after the last one), sent
+    // with Transfer-Encoding: chunked so the payload is generated while it is written.
+    struct StreamBody {
+        using producer_type = std::function<bool(std::string &)>;
+
+        struct value_type {
+            std::pmr::string data;
+            std::shared_ptr<const std::string> shared; // used instead of data when set
+            producer_type producer;
+            std::optional<Wait> wait;
+
+            value_type() = default;
+
+            explicit value_type(std::pmr::memory_resource *resource) : data(resource) {}
+        };
+
+        static std::uint64_t size(const value_type &body) {
+            return body.shared ? body.shared->size() : body.data.size();
+        }
+
+        class writer {
+        public:
+            using const_buffers_type = boost::asio::const_buffer;
+
+            template<bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields> &, const value_type &body) : body_(body) {}
+
+            void init(beast::error_code &ec) {
+                ec = {};
+            }
+
+            boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code &ec) {
+                ec = {};
+                if (!body_.producer) {
+                    if (sent_) return boost::none;
+                    sent_ = true;
+                    const std::string_view data = body_.shared ? std::string_view(*body_.shared) : std::string_view(body_.data);
+                    return {{boost::asio::buffer(data.data(), data.size()), false}};
+                }
+
+                bool more = true;
+                chunk_.clear();
+                try {
+                    while (more && chunk_.empty()) more = body_.producer(chunk_);
+                } catch (const std::exception &) {
+                    // headers are already out: the only signal left is an unterminated chunked body
+                    ec = make_error_code(boost::system::errc::io_error);
+                    return boost::none;
+                }
+                if (chunk_.empty()) return boost::none;
+                return {{boost::asio::buffer(chunk_), more}};
+            }
+
+        private:
+            const value_type &body_;
+            std::string chunk_;
+            bool sent_ = false;
+        };
+    };
+
+    using Request  = http::request<http::basic_string_body<char, std::char_traits<char>, std::pmr::polymorphic_allocator<char>>, Fields>;
+    using Response = http::response<StreamBody, Fields>;
+
+    // the memory a message draws from: its connection's arena, or the default heap
+    inline std::pmr::memory_resource* resource_of(const Fields& fields) {
+        return fields.get_allocator().resource();
+    }
+
+    // an empty response whose fields and body draw from resource
+    inline Response make_response(std::pmr::memory_resource* resource) {
+        return Response(std::piecewise_construct, std::make_tuple(resource), std::make_tuple(Allocator(resource)));
+    }
+
+    // JSON values built for a message go to its arena as well
+    inline boost::json::storage_ptr json_storage(const Fields& fields) {
+        RequestArena* arena = RequestArena::of(resource_of(fields));
+        return arena ? arena->json() : boost::json::storage_ptr();
+    }
+
+    inline boost::json::value parse_json(const Request& req) {
+        return boost::json::parse(req.body(), json_storage(req));
+    }
 
     inline bool is_json(const Request& req) {
         return req[http::field::content_type].starts_with("application/json");
     }
 
+    // appends the text of value to out, through a stack buffer instead of a temporary string
+    template<typename String>
+    void serialize_to(String& out, const boost::json::value& value) {
+        unsigned char stack[256];
+        boost::json::serializer serializer(boost::json::storage_ptr(), stack, sizeof(stack));
+        serializer.reset(&value);
+        while (!serializer.done()) {
+            const std::size_t size = out.size();
+            out.resize(std::max(out.capacity(), size + 128));
+            out.resize(size + serializer.read(out.data() + size, out.size() - size).size());
+        }
+    }
+
     inline void set_json(Response& res, const boost::json::value& value, int status_code = 200) {
         res.result(http::status(status_code));
         res.set(http::field::content_type, "application/json");
-        res.body() = boost::json::serialize(value);
+        res.body().data.clear();
+        serialize_to(res.body().data, value);
+        res.prepare_payload();
+    }
+
+    // `set_json(res, {{"status", "done"}})` builds the value in the response's arena
+    inline void set_json(Response& res, std::initializer_list<boost::json::value_ref> init, int status_code = 200) {
+        set_json(res, boost::json::value(init, json_storage(res)), status_code);
+    }
+
+    // write(std::string&) appends the JSON text directly to the body
+    template<typename Write>
+    void write_json(Response& res, Write&& write, int status_code = 200) {
+        res.result(http::status(status_code));
+        res.set(http::field::content_type, "application/json");
+        res.body().data.clear();
+        write(res.body().data);
+        res.prepare_payload();
+    }
+
+    // a body owned with others (a cache entry), sent as is
+    inline void set_shared(Response& res, std::shared_ptr<const std::string> body, std::string_view content_type,
+                           int status_code = 200) {
+        res.result(http::status(status_code));
+        res.set(http::field::content_type, content_type);
+        res.body().data.clear();
+        res.body().shared = std::move(body);
         res.prepare_payload();
     }
 
     inline void set_text(Response& res, std::string_view text, int status_code = 200) {
         res.result(http::status(status_code));
         res.set(http::field::content_type, "text/plain");
-        res.body() = std::string(text);
+        res.body().data.assign(text);
         res.prepare_payload();
     }
 
@@ -34,20 +180,117 @@ namespace http_util {
             res.result(http::status::ok);
             res.set(http::field::content_type, "text/" + std::string(Mime.data));
             res.set(http::field::content_disposition, "attachment; filename=\"" + filename + "\"");
-            res.body() = std::string(content);
+            res.body().data.assign(content);
+            res.prepare_payload();
+        }
+
+        static void apply(Response& res, std::shared_ptr<const std::string> content, const std::string& filename) {
+            res.result(http::status::ok);
+            res.set(http::field::content_type, "text/" + std::string(Mime.data));
+            res.set(http::field::content_disposition, "attachment; filename=\"" + filename + "\"");
+            res.body().shared = std::move(content);
             res.prepare_payload();
         }
+
+        static void stream(Response& res, StreamBody::producer_type producer, const std::string& filename) {
+            res.result(http::status::ok);
+            res.set(http::field::content_type, "text/" + std::string(Mime.data));
+            res.set(http::field::content_disposition, "attachment; filename=\"" + filename + "\"");
+            res.body().producer = std::move(producer);
+            res.chunked(true);
+        }
     };
 
+    // 405 naming the expected methods (the first one in the body, all of them in Allow)
+    inline void set_method_not_allowed(Response& res, const std::vector<http::verb>& allowed, http::verb got) {
+        std::string allow;
+        for (auto method : allowed) {
+            if (!allow.empty()) allow += ", ";
+            allow += http::to_string(method);
+        }
+        res.set(http::field::allow, allow);
+        set_json(res, {
+                {"error", "Method Not Allowed"},
+                {"expected", allowed.empty() ? std::string_view() : http::to_string(allowed.front())},
+                {"got",     http::to_string(got)}
+        }, 405);
+    }
+
     inline bool check_method(const Request& req, http::verb expected, Response& res) {
         if (req.method() != expected) {
-            set_json(res, {
-                    {"error", "Method Not Allowed"},
-                    {"expected", http::to_string(expected)},
-                    {"got",     http::to_string(req.method())}
-            }, 405);
+            set_method_not_allowed(res, {expected}, req.method());
             return false;
         }
         return true;
     }
+
+    // If-None-Match names etag (weak comparison, lists and `*` included)
+    inline bool etag_matches(const Request& req, std::string_view etag) {
+        std::string_view header = req[http::field::if_none_match];
+        while (!header.empty()) {
+            const auto comma = header.find(',');
+            std::string_view tag = header.substr(0, comma);
+            header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+            while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) tag.remove_prefix(1);
+            while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) tag.remove_suffix(1);
+            if (tag.starts_with("W/")) tag.remove_prefix(2);
+            if (tag == "*" || tag == etag) return true;
+        }
+        return false;
+    }
+
+    // Sets ETag; answers 304 Not Modified and returns true when the client already holds it
+    inline bool not_modified(const Request& req, Response& res, std::string_view etag) {
+        res.set(http::field::etag, etag);
+        if (!etag_matches(req, etag)) return false;
+        res.result(http::status::not_modified);
+        res.body().data.clear();
+        res.prepare_payload();
+        return true;
+    }
+
+    // Value of `key` in the query string of target, as a view into it (not percent-decoded)
+    inline std::optional<std::string_view> query_param(std::string_view target, std::string_view key) {
+        const auto pos = target.find('?');
+        if (pos == std::string_view::npos) return std::nullopt;
+
+        std::string_view query = target.substr(pos + 1);
+        while (!query.empty()) {
+            const auto amp = query.find('&');
+            const std::string_view pair = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+
+            const auto eq = pair.find('=');
+            if (eq == std::string_view::npos) continue;
+            if (pair.substr(0, eq) == key) return pair.substr(eq + 1);
+        }
+        return std::nullopt;
+    }
+
+    // %XX escapes and '+' of a query value decoded; throws on a malformed escape
+    inline std::pmr::string percent_decode(std::string_view value,
+                                           std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+        auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            throw std::invalid_argument("Invalid percent escape");
+        };
+
+        std::pmr::string out(resource);
+        out.reserve(value.size());
+        for (std::size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '+') {
+                out += ' ';
+            } else if (value[i] == '%') {
+                if (i + 2 >= value.size()) throw std::invalid_argument("Invalid percent escape");
+                out += static_cast<char>(nibble(value[i + 1]) << 4 | nibble(value[i + 2]));
+                i += 2;
+            } else {
+                out += value[i];
+            }
+        }
+        return out;
+    }
 }
@@ -0,0 +1,86 @@
+#pragma once
+#include <charconv>
+#include <string>
+#include <string_view>
+#include "../Entity/Todo.hpp"
+
+// Writes JSON text straight into an output string (std::string or a response's
+// std::pmr::string), without building a boost::json tree.
+// The bytes match what boost::json::serialize produces for the equivalent value.
+namespace json_writer {
+
+    template<typename String>
+    void append_string(String& out, std::string_view s) {
+        static constexpr char hex[] = "0123456789abcdef";
+        out += '"';
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            const auto c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+            out.append(s.data() + run, i - run);
+            run = i + 1;
+            out += '\\';
+            switch (c) {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '\b': out += 'b'; break;
+                case '\f': out += 'f'; break;
+                case '\n': out += 'n'; break;
+                case '\r': out += 'r'; break;
+                case '\t': out += 't'; break;
+                default:
+                    out += "u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+            }
+        }
+        out.append(s.data() + run, s.size() - run);
+        out += '"';
+    }
+
+    template<typename String, typename Number>
+    void append_number(String& out, Number value) {
+        char digits[24];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    // {"name":...,"due_date":...,"priority":...,"tags":[...]}, same shape as to_json()
+    template<typename String>
+    void append_todo(String& out, const Todo& todo) {
+        out += "{\"name\":";
+        append_string(out, todo.name_view());
+        if (todo.due_timestamp != UINT64_MAX) {
+            out += ",\"due_date\":\"";
+            append_iso_timestamp(out, todo.due_timestamp);
+            out += '"';
+        }
+        if (todo.priority) {
+            out += ",\"priority\":";
+            append_number(out, todo.priority);
+        }
+        if (todo.tags[0] != '\0') {
+            out += ",\"tags\":[";
+            for_each_tag(todo.tags, [&](std::size_t offset, std::size_t size) {
+                if (offset) out += ',';
+                append_string(out, std::string_view(todo.tags.data + offset, size));
+            });
+            out += ']';
+        }
+        out += '}';
+    }
+
+    template<typename String, typename Range>
+    void append_todos(String& out, const Range& todos) {
+        // typical record: short name plus a 20-byte date
+        out.reserve(out.size() + std::size(todos) * 56 + 2);
+        out += '[';
+        bool first = true;
+        for (const Todo& todo : todos) {
+            if (!first) out += ',';
+            first = false;
+            append_todo(out, todo);
+        }
+        out += ']';
+    }
+}
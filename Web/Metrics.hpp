@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+// Server metrics in per-thread slots: recording only writes the calling thread's own
+// cache lines (no atomic read-modify-write, no lock), and a scrape adds the slots up.
+class Metrics {
+public:
+    // Latency buckets over microseconds, HDR style: 8 linear sub-buckets per power of two
+    // (at most 12.5% relative error), up to about 2^38 us
+    static constexpr std::size_t sub_buckets = 8;
+    static constexpr std::size_t bucket_count = 36 * sub_buckets;
+
+    // series of a request that matched no route (404 / 405)
+    static constexpr std::size_t unmatched = SIZE_MAX;
+
+    struct Summary {
+        std::uint64_t count = 0;
+        std::uint64_t sum_ns = 0;
+        std::array<std::uint64_t, 5> classes{}; // 1xx .. 5xx
+        std::array<std::uint64_t, bucket_count> buckets{};
+
+        // upper bound of the bucket holding the q-quantile, in seconds (NaN when empty)
+        double quantile(double q) const {
+            if (count == 0) return std::nan("");
+            const auto rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(count)));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                seen += buckets[i];
+                if (seen >= std::max<std::uint64_t>(rank, 1)) return static_cast<double>(bucket_upper(i) + 1) * 1e-6;
+            }
+            return static_cast<double>(bucket_upper(bucket_count - 1) + 1) * 1e-6;
+        }
+    };
+
+    static Metrics &instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    // Labels of the routes (`route="/x",method="GET"`), indexed like Router ids.
+    // Call once at startup, before any request is recorded.
+    void configure(std::vector<std::string> route_labels) {
+        std::lock_guard lock(mutex_);
+        route_labels_ = std::move(route_labels);
+    }
+
+    void record_request(std::size_t route, unsigned status, std::chrono::nanoseconds elapsed) noexcept {
+        record(route == unmatched ? unmatched_series : first_route + route, status, elapsed);
+    }
+
+    void record_import(std::chrono::nanoseconds elapsed) noexcept {
+        record(import_series, 200, elapsed);
+    }
+
+    void record_export(std::chrono::nanoseconds elapsed) noexcept {
+        record(export_series, 200, elapsed);
+    }
+
+    void connection_opened() noexcept { slot().opened.add(1); }
+
+    void connection_closed() noexcept { slot().closed.add(1); }
+
+    // Prometheus text format of everything recorded here
+    void render(std::string &out) const {
+        std::lock_guard lock(mutex_);
+
+        out += "# HELP todo_http_requests_total Requests answered, by route, method and status class.\n"
+               "# TYPE todo_http_requests_total counter\n";
+        std::vector<Summary> routes;
+        routes.reserve(route_labels_.size() + 1);
+        for (std::size_t i = 0; i <= route_labels_.size(); ++i) {
+            routes.push_back(collect(i == route_labels_.size() ? unmatched_series : first_route + i));
+            const std::string &labels = i == route_labels_.size() ? unmatched_label : route_labels_[i];
+            for (std::size_t c = 0; c < routes.back().classes.size(); ++c) {
+                if (routes.back().classes[c] == 0) continue;
+                line(out, "todo_http_requests_total", labels + ",code=\"" + std::to_string(c + 1) + "xx\"", routes.back().classes[c]);
+            }
+        }
+
+        out += "# HELP todo_http_request_duration_seconds Time to produce a response, by route and method.\n"
+               "# TYPE todo_http_request_duration_seconds summary\n";
+        for (std::size_t i = 0; i < routes.size(); ++i) {
+            summary(out, "todo_http_request_duration_seconds", i == route_labels_.size() ? unmatched_label : route_labels_[i], routes[i]);
+        }
+
+        out += "# HELP todo_import_duration_seconds Duration of CSV imports.\n"
+               "# TYPE todo_import_duration_seconds summary\n";
+        summary(out, "todo_import_duration_seconds", "", collect(import_series));
+        out += "# HELP todo_export_duration_seconds Duration of completed CSV exports.\n"
+               "# TYPE todo_export_duration_seconds summary\n";
+        summary(out, "todo_export_duration_seconds", "", collect(export_series));
+
+        std::uint64_t opened = 0, closed = 0;
+        for (const auto &slot: slots_) {
+            opened += slot->opened.get();
+            closed += slot->closed.get();
+        }
+        out += "# HELP todo_http_active_connections Open client connections.\n"
+               "# TYPE todo_http_active_connections gauge\n";
+        line(out, "todo_http_active_connections", "", opened > closed ? opened - closed : 0);
+    }
+
+    // one sample: `name{labels} value`
+    static void line(std::string &out, std::string_view name, std::string_view labels, double value) {
+        char buf[32];
+        if (std::isnan(value)) std::snprintf(buf, sizeof(buf), "NaN");
+        else std::snprintf(buf, sizeof(buf), "%.9g", value);
+        sample(out, name, labels, buf);
+    }
+
+    static void line(std::string &out, std::string_view name, std::string_view labels, std::uint64_t value) {
+        sample(out, name, labels, std::to_string(value));
+    }
+
+private:
+    static constexpr std::size_t import_series = 0;
+    static constexpr std::size_t export_series = 1;
+    static constexpr std::size_t unmatched_series = 2;
+    static constexpr std::size_t first_route = 3;
+    static constexpr const char *unmatched_label = "route=\"unmatched\",method=\"\"";
+
+    // written by one thread only, read by scrapes: relaxed load + store, no lock prefix
+    struct Counter {
+        std::atomic<std::uint64_t> value{0};
+
+        void add(std::uint64_t n) noexcept {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        std::uint64_t get() const noexcept { return value.load(std::memory_order_relaxed); }
+    };
+
+    struct alignas(64) Series {
+        Counter count, sum_ns;
+        Counter classes[5];
+        Counter buckets[bucket_count];
+    };
+
+    struct alignas(64) Slot {
+        explicit Slot(std::size_t series_count)
+                : series(std::make_unique<Series[]>(series_count)), size(series_count) {}
+
+        std::unique_ptr<Series[]> series;
+        std::size_t size;
+        Counter opened, closed;
+    };
+
+    mutable std::mutex mutex_;            // slot registration, configuration and scrapes
+    std::vector<std::string> route_labels_;
+    std::deque<std::unique_ptr<Slot>> slots_; // never freed: counts of exited threads stay in the totals
+
+    Metrics() = default;
+
+    // the calling thread's slot, registered on first use
+    Slot &slot() {
+        thread_local Slot *mine = nullptr;
+        if (!mine) {
+            std::lock_guard lock(mutex_);
+            mine = slots_.emplace_back(std::make_unique<Slot>(first_route + route_labels_.size())).get();
+        }
+        return *mine;
+    }
+
+    void record(std::size_t index, unsigned status, std::chrono::nanoseconds elapsed) noexcept {
+        Slot &s = slot();
+        if (index >= s.size) return;
+        Series &series = s.series[index];
+        const auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(0, elapsed.count()));
+        series.count.add(1);
+        series.sum_ns.add(ns);
+        if (status >= 100 && status < 600) series.classes[status / 100 - 1].add(1);
+        series.buckets[bucket_of(ns / 1000)].add(1);
+    }
+
+    // caller holds mutex_
+    Summary collect(std::size_t index) const {
+        Summary total;
+        for (const auto &slot: slots_) {
+            if (index >= slot->size) continue;
+            const Series &series = slot->series[index];
+            total.count += series.count.get();
+            total.sum_ns += series.sum_ns.get();
+            for (std::size_t c = 0; c < total.classes.size(); ++c) total.classes[c] += series.classes[c].get();
+            for (std::size_t b = 0; b < bucket_count; ++b) total.buckets[b] += series.buckets[b].get();
+        }
+        return total;
+    }
+
+    static void sample(std::string &out, std::string_view name, std::string_view labels, std::string_view value) {
+        out += name;
+        if (!labels.empty()) {
+            out += '{';
+            out += labels;
+            out += '}';
+        }
+        out += ' ';
+        out += value;
+        out += '\n';
+    }
+
+    static void summary(std::string &out, std::string_view name, const std::string &labels, const Summary &s) {
+        const std::string sep = labels.empty() ? "" : ",";
+        for (const auto &[q, text]: {std::pair{0.5, "0.5"}, std::pair{0.99, "0.99"}, std::pair{0.999, "0.999"}}) {
+            line(out, name, labels + sep + "quantile=\"" + text + "\"", s.quantile(q));
+        }
+        line(out, std::string(name) + "_sum", labels, static_cast<double>(s.sum_ns) * 1e-9);
+        line(out, std::string(name) + "_count", labels, s.count);
+    }
+
+    static std::size_t bucket_of(std::uint64_t us) noexcept {
+        if (us < sub_buckets) return us;
+        const auto msb = static_cast<std::size_t>(std::bit_width(us) - 1);
+        const std::size_t index = (msb - 2) * sub_buckets + ((us >> (msb - 3)) & (sub_buckets - 1));
+        return std::min(index, bucket_count - 1);
+    }
+
+    static std::uint64_t bucket_upper(std::size_t index) noexcept {
+        if (index < sub_buckets) return index;
+        const std::size_t msb = index / sub_buckets + 2;
+        const std::uint64_t sub = index % sub_buckets;
+        return ((sub_buckets + sub + 1) << (msb - 3)) - 1;
+    }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+
+// Memory of the request a connection is serving: its header fields and body, the JSON
+// parsed from it and the response built for it. Allocation is a pointer bump into one
+// buffer and nothing is freed until reset() drops it all between requests.
+// The buffer grows to the largest request seen (up to max_bytes), so once a connection has
+// warmed up its requests allocate nothing; a larger one spills to the heap for its duration.
+class RequestArena final : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t initial_bytes = 4096;
+    static constexpr std::size_t default_max_bytes = std::size_t{64} << 10;
+
+    explicit RequestArena(std::size_t max_bytes = default_max_bytes)
+            : max_bytes_(std::max(max_bytes, initial_bytes)),
+              size_(initial_bytes),
+              buffer_(std::make_unique_for_overwrite<std::byte[]>(size_)),
+              json_(*this) {
+        pool_.emplace(buffer_.get(), size_, &spill_);
+    }
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    // Ends the current request: everything allocated since the last reset is released
+    void reset() {
+        pool_->release();
+        if (spill_.bytes && size_ < max_bytes_) {
+            size_ = std::min(max_bytes_, std::bit_ceil(size_ + spill_.bytes));
+            pool_.reset();
+            buffer_ = std::make_unique_for_overwrite<std::byte[]>(size_);
+            pool_.emplace(buffer_.get(), size_, &spill_);
+        }
+        spill_.bytes = 0;
+    }
+
+    // for boost::json values (it takes its own memory_resource type)
+    boost::json::storage_ptr json() noexcept { return &json_; }
+
+    // The arena a message was allocated from, null for one on the default heap
+    static RequestArena *of(std::pmr::memory_resource *resource) noexcept {
+        return dynamic_cast<RequestArena *>(resource);
+    }
+
+private:
+    // upstream of the buffer: counts what it could not hold, to size the next one
+    struct Spill final : std::pmr::memory_resource {
+        std::size_t bytes = 0;
+
+        void *do_allocate(std::size_t size, std::size_t alignment) override {
+            bytes += size;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void *p, std::size_t size, std::size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    struct JsonResource final : boost::json::memory_resource {
+        RequestArena &arena;
+
+        explicit JsonResource(RequestArena &a) : arena(a) {}
+
+        void *do_allocate(std::size_t size, std::size_t alignment) override {
+            return arena.allocate(size, alignment);
+        }
+
+        void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+        bool do_is_equal(const boost::json::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    void *do_allocate(std::size_t size, std::size_t alignment) override {
+        return pool_->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    std::size_t max_bytes_;
+    std::size_t size_;
+    std::unique_ptr<std::byte[]> buffer_;
+    Spill spill_;
+    std::optional<std::pmr::monotonic_buffer_resource> pool_;
+    JsonResource json_;
+};
+
+// Allocator over a memory resource for Beast's header fields, which need one that can be
+// assigned (std::pmr::polymorphic_allocator cannot). It travels with the memory on a move.
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    ArenaAllocator() noexcept = default;
+
+    ArenaAllocator(std::pmr::memory_resource *resource) noexcept : resource_(resource) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : resource_(other.resource()) {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    std::pmr::memory_resource *resource() const noexcept { return resource_; }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept {
+        return resource_ == other.resource() || resource_->is_equal(*other.resource());
+    }
+
+private:
+    std::pmr::memory_resource *resource_ = std::pmr::get_default_resource();
+};
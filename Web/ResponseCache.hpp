@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Serialized full-store responses, one per kind, valid for one repository generation.
+// Repeated reads of an unchanged store share the same body instead of rebuilding it.
+class ResponseCache {
+public:
+    enum class Kind : std::size_t { all, export_csv, count };
+
+    // bodies over this size are streamed and not kept
+    static constexpr std::size_t max_body_bytes = std::size_t{64} << 20;
+
+    static ResponseCache &instance() {
+        static ResponseCache cache;
+        return cache;
+    }
+
+    // the body stored for generation, or null
+    std::shared_ptr<const std::string> find(Kind kind, std::uint64_t generation) const {
+        const Entry &entry = entries_[static_cast<std::size_t>(kind)];
+        std::lock_guard lock(entry.mutex);
+        return entry.generation == generation ? entry.body : nullptr;
+    }
+
+    void store(Kind kind, std::uint64_t generation, std::shared_ptr<const std::string> body) {
+        Entry &entry = entries_[static_cast<std::size_t>(kind)];
+        std::lock_guard lock(entry.mutex);
+        entry.generation = generation;
+        entry.body = std::move(body);
+    }
+
+    // Strong ETag of a generation; the process id part keeps tags from before a restart
+    // (when generations count from 0 again) from matching
+    std::string etag(std::uint64_t generation) const {
+        char buf[48];
+        std::snprintf(buf, sizeof(buf), "\"%llx-%llx\"", static_cast<unsigned long long>(boot_id_),
+                      static_cast<unsigned long long>(generation));
+        return buf;
+    }
+
+private:
+    struct Entry {
+        mutable std::mutex mutex; // held only to swap the pointer
+        std::uint64_t generation = UINT64_MAX;
+        std::shared_ptr<const std::string> body;
+    };
+
+    std::array<Entry, static_cast<std::size_t>(Kind::count)> entries_;
+    std::uint64_t boot_id_ = static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+
+    ResponseCache() = default;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+#include "views.h"
+
+// Dispatches (method, path) to a view without allocating.
+// Paths live in an open-addressed table whose hash seed is searched at startup until every
+// path gets its own slot (a perfect hash), so a lookup is one hash, one slot and one compare.
+class Router {
+public:
+    struct Endpoint {
+        http_util::http::verb method;
+        views::HandlerFunc handler;
+        std::size_t id; // dense over all endpoints, in registration order
+    };
+
+    struct Route {
+        std::string path;
+        std::vector<Endpoint> methods;
+    };
+
+    enum class Status { found, not_found, method_not_allowed };
+
+    struct Match {
+        Status status;
+        views::HandlerFunc handler = nullptr;
+        const Route* route = nullptr; // set unless not_found
+        std::size_t id = 0;           // of the endpoint, when found
+    };
+
+    explicit Router(const std::vector<views::View>& views) {
+        for (const auto& view : views) {
+            Route* route = nullptr;
+            for (auto& r : routes_) {
+                if (r.path == view.path) route = &r;
+            }
+            if (!route) route = &routes_.emplace_back(Route{view.path, {}});
+            for (const auto& endpoint : route->methods) {
+                if (endpoint.method == view.method) throw std::logic_error("Duplicate route: " + route->path);
+            }
+            route->methods.push_back({view.method, view.func, endpoints_++});
+        }
+        build_table();
+    }
+
+    Match find(http_util::http::verb method, std::string_view path) const noexcept {
+        const std::uint16_t index = slots_[hash(path, seed_) & mask_];
+        if (index == empty || routes_[index].path != path) return {Status::not_found};
+
+        const Route& route = routes_[index];
+        for (const auto& endpoint : route.methods) {
+            if (endpoint.method == method) return {Status::found, endpoint.handler, &route, endpoint.id};
+        }
+        return {Status::method_not_allowed, nullptr, &route};
+    }
+
+    const std::vector<Route>& routes() const noexcept { return routes_; }
+
+    std::size_t endpoint_count() const noexcept { return endpoints_; }
+
+private:
+    static constexpr std::uint16_t empty = UINT16_MAX;
+    static constexpr std::uint64_t seeds_per_size = 1 << 12;
+
+    std::vector<Route> routes_;
+    std::size_t endpoints_ = 0;
+    std::vector<std::uint16_t> slots_;
+    std::uint64_t seed_ = 0;
+    std::uint64_t mask_ = 0;
+
+    // seeded FNV-1a, folded so the low bits see the whole word
+    static std::uint64_t hash(std::string_view s, std::uint64_t seed) noexcept {
+        std::uint64_t h = 14695981039346656037ULL ^ seed;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+    void build_table() {
+        if (routes_.size() >= empty) throw std::length_error("Too many routes");
+        std::size_t size = std::bit_ceil(std::max<std::size_t>(2 * routes_.size(), 1));
+        for (;; size *= 2) {
+            mask_ = size - 1;
+            for (seed_ = 0; seed_ < seeds_per_size; ++seed_) {
+                if (try_place(size)) return;
+            }
+        }
+    }
+
+    bool try_place(std::size_t size) {
+        slots_.assign(size, empty);
+        for (std::size_t i = 0; i < routes_.size(); ++i) {
+            auto& slot = slots_[hash(routes_[i].path, seed_) & mask_];
+            if (slot != empty) return false;
+            slot = static_cast<std::uint16_t>(i);
+        }
+        return true;
+    }
+};
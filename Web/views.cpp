@@ -1,16 +1,20 @@
 #include "views.h"
 #include "HttpUtils.hpp"
-#include <boost/asio/ip/tcp.hpp>
+#include "JsonWriter.hpp"
+#include "Metrics.hpp"
+#include "ResponseCache.hpp"
 #include <boost/json.hpp>
 #include <iostream>
-#include <sstream>
+#include <atomic>
+#include <charconv>
+#include <algorithm>
 #include "../Application/TodoManager.hpp"
 
 namespace json = boost::json;
 using http_util::Request;
 using http_util::Response;
-using http_util::check_method;
 using http_util::set_json;
+using http_util::write_json;
 
 namespace download_types {
     constexpr jh::pod::array<char, 8> CSV = {"csv"};
@@ -18,103 +22,142 @@ namespace download_types {
 
 using set_csv = http_util::set_download<download_types::CSV>;
 
-std::unordered_map<std::string, views::HandlerFunc> views::function_map;
+std::vector<views::View> views::registry;
 
 extern std::atomic<bool> g_should_exit;
-extern std::unique_ptr<boost::asio::ip::tcp::acceptor> global_acceptor;
+extern void request_shutdown();
 
 inline uint64_t parse_timestamp_field(const boost::json::value& val) {
     if (val.is_int64()) {
         return static_cast<uint64_t>(val.as_int64());
     } else if (val.is_string()) {
-        return parse_date_string_to_timestamp(std::string(val.as_string()));
+        return parse_date_string_to_timestamp(std::string_view(val.as_string()));
     } else {
         throw std::invalid_argument("Invalid timestamp format: must be integer or string");
     }
 }
 
-inline std::optional<std::string> get_query_param(const boost::beast::http::request<boost::beast::http::string_body>& req, std::string_view key) {
-    std::string target = std::string(req.target());
-    auto pos = target.find('?');
-    if (pos == std::string::npos) return std::nullopt;
+// query value: a unix timestamp or a date string
+inline uint64_t parse_timestamp_param(std::string_view value) {
+    uint64_t ts = 0;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), ts);
+    if (ec == std::errc() && ptr == value.data() + value.size()) return ts;
+    return parse_date_string_to_timestamp(value);
+}
 
-    std::string_view query = std::string_view(target).substr(pos + 1);
-    while (!query.empty()) {
-        auto eq = query.find('=');
-        if (eq == std::string_view::npos) break;
+// Opaque keyset cursor: hex of the (due_timestamp, name) of the last todo of a page,
+// appended as a JSON string
+template<typename String>
+void append_cursor(String& out, const Todo& todo) {
+    static constexpr char digits[] = "0123456789abcdef";
+    const std::string_view name = todo.name_view();
+    out += '"';
+    for (int shift = 60; shift >= 0; shift -= 4) out += digits[(todo.due_timestamp >> shift) & 0xF];
+    for (unsigned char c : name) {
+        out += digits[c >> 4];
+        out += digits[c & 0xF];
+    }
+    out += '"';
+}
 
-        std::string_view k = query.substr(0, eq);
-        query.remove_prefix(eq + 1);
+inline Todo decode_cursor(std::string_view cursor) {
+    auto nibble = [](char c) -> unsigned {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        throw std::invalid_argument("Invalid cursor");
+    };
+    if (cursor.size() < 16 || cursor.size() % 2 != 0 || cursor.size() > 16 + 2 * 63)
+        throw std::invalid_argument("Invalid cursor");
+
+    Todo todo;
+    todo.due_timestamp = 0;
+    for (std::size_t i = 0; i < 16; ++i) todo.due_timestamp = todo.due_timestamp << 4 | nibble(cursor[i]);
+    for (std::size_t i = 16, k = 0; i < cursor.size(); i += 2, ++k) {
+        todo.name[k] = static_cast<char>(nibble(cursor[i]) << 4 | nibble(cursor[i + 1]));
+    }
+    return todo;
+}
 
-        auto amp = query.find('&');
-        std::string_view v = (amp == std::string_view::npos) ? query : query.substr(0, amp);
-        if (amp != std::string_view::npos) query.remove_prefix(amp + 1);
-        else query = {};
+// Cursor of a priority-ordered page: two hex digits of the priority, then as append_cursor
+template<typename String>
+void append_priority_cursor(String& out, const Todo& todo) {
+    static constexpr char digits[] = "0123456789abcdef";
+    const std::size_t quote = out.size();
+    append_cursor(out, todo);
+    out.insert(quote + 1, {digits[todo.priority >> 4], digits[todo.priority & 0xF]});
+}
 
-        if (k == key) return std::string(v);
-    }
+inline Todo decode_priority_cursor(std::string_view cursor) {
+    uint8_t priority = 0;
+    if (cursor.size() < 2 || std::from_chars(cursor.data(), cursor.data() + 2, priority, 16).ptr != cursor.data() + 2)
+        throw std::invalid_argument("Invalid cursor");
+    Todo todo = decode_cursor(cursor.substr(2));
+    todo.priority = priority;
+    return todo;
+}
 
-    return std::nullopt;
+inline std::optional<std::string_view> get_query_param(const Request& req, std::string_view key) {
+    return http_util::query_param(req.target(), key);
+}
+
+// unsigned query value, `error` when it is not one
+template<typename T>
+inline T parse_number_param(std::string_view value, const char* error) {
+    T number{};
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (ec != std::errc() || ptr != value.data() + value.size()) throw std::invalid_argument(error);
+    return number;
 }
 
 
-REGISTER_VIEW(ping) {
-    if (!check_method(req, http_util::http::verb::get, res)) return;
+REGISTER_VIEW(ping, get) {
     set_json(res, {{"status", "alive"}});
 }
 
-REGISTER_VIEW(shutdown_server) {
-    if (!check_method(req, http_util::http::verb::post, res)) return;
-
+REGISTER_VIEW(shutdown_server, post) {
     if (!g_should_exit.exchange(true)) {
         std::cout << "Called Exit\n";
-
-        if (global_acceptor && global_acceptor->is_open()) {
-            boost::system::error_code ec;
-            global_acceptor->cancel(ec); // NOLINT
-        }
-
-        try {
-            boost::asio::io_context ioc;
-            boost::asio::ip::tcp::socket s(ioc);
-            s.connect({boost::asio::ip::address_v4::loopback(), 8080});
-        } catch (...) {}
+        request_shutdown();
     }
 
     set_json(res, {{"status", "server_shutdown_requested"}});
 }
 
-REGISTER_VIEW(todo_create) {
-    if (!check_method(req, http_util::http::verb::post, res)) return;
-
+REGISTER_VIEW(todo_create, post) {
     try {
-        auto obj = json::parse(req.body()).as_object();
-        Todo todo = parse_todo_from_json(obj);
+        const auto value = http_util::parse_json(req);
+        Todo todo = parse_todo_from_json(value.as_object());
 
         if (!TodoManager::add_todo(todo)) {
             set_json(res, {{"error", "Todo already exists"}}, 400);
         } else {
             set_json(res, {{"status", "created"}}, 201);
         }
+    } catch (const JournalFailed& e) {
+        set_json(res, {{"error", e.what()}}, 503);
     } catch (const std::exception& e) {
         set_json(res, {{"error", e.what()}}, 400);
     }
 }
 
-REGISTER_VIEW(todo_all) {
-    if (!check_method(req, http_util::http::verb::get, res)) return;
-
-    auto list = TodoManager::all();
-    json::array arr;
-    for (const auto& todo : list)
-        arr.push_back(to_json(todo));
-
-    set_json(res, arr);
+// full listings are answered from ResponseCache while the store is unchanged, or with 304
+REGISTER_VIEW(todo_all, get) {
+    auto& cache = ResponseCache::instance();
+    const auto generation = TodoManager::generation();
+    if (http_util::not_modified(req, res, cache.etag(generation))) return;
+
+    auto body = cache.find(ResponseCache::Kind::all, generation);
+    if (!body) {
+        std::string out;
+        json_writer::append_todos(out, TodoManager::all());
+        body = std::make_shared<const std::string>(std::move(out));
+        // a mutation that finished meanwhile may be in the body: then it belongs to no generation
+        if (TodoManager::generation() == generation) cache.store(ResponseCache::Kind::all, generation, body);
+    }
+    http_util::set_shared(res, std::move(body), "application/json");
 }
 
-REGISTER_VIEW(todo_get) {
-    if (!check_method(req, http_util::http::verb::get, res)) return;
-
+REGISTER_VIEW(todo_get, get) {
     auto name_opt = get_query_param(req, "name");
     if (!name_opt) {
         set_json(res, {{"error", "Missing 'name' parameter"}}, 400);
@@ -125,14 +168,12 @@ REGISTER_VIEW(todo_get) {
     if (!todo) {
         set_json(res, {{"error", "Todo not found"}}, 404);
     } else {
-        set_json(res, to_json(*todo));
+        write_json(res, [&](auto& out) { json_writer::append_todo(out, *todo); });
     }
 }
 
 
-REGISTER_VIEW(todo_exists) {
-    if (!check_method(req, http_util::http::verb::head, res)) return;
-
+REGISTER_VIEW(todo_exists, head) {
     auto name = req.base()["name"];
     if (name.empty() || !TodoManager::exists(name)) {
         res.result(http_util::http::status::not_found);
@@ -142,25 +183,340 @@ REGISTER_VIEW(todo_exists) {
     res.prepare_payload();
 }
 
-REGISTER_VIEW(todo_before) {
-    if (!check_method(req, http_util::http::verb::post, res)) return;
-
+REGISTER_VIEW(todo_before, post) {
     try {
-        const auto obj = boost::json::parse(req.body()).as_object();
-        uint64_t ts = parse_timestamp_field(obj.at("before"));
+        const auto value = http_util::parse_json(req);
+        uint64_t ts = parse_timestamp_field(value.as_object().at("before"));
 
         auto todos = TodoManager::range_before(ts);
-        boost::json::array arr;
-        for (const auto& t : todos) arr.push_back(to_json(t));
-        set_json(res, arr);
+        write_json(res, [&](auto& out) { json_writer::append_todos(out, todos); });
+    } catch (const std::exception& e) {
+        set_json(res, {{"error", e.what()}}, 400);
+    }
+}
+
+REGISTER_VIEW(todo_range, get) {
+    constexpr std::size_t default_limit = 100;
+    constexpr std::size_t max_limit = 10000;
+
+    try {
+        const auto from = get_query_param(req, "from");
+        const auto to = get_query_param(req, "to");
+        const auto limit_param = get_query_param(req, "limit");
+        const auto cursor = get_query_param(req, "cursor");
+
+        std::size_t limit = limit_param ? parse_number_param<std::size_t>(*limit_param, "Invalid limit") : default_limit;
+        limit = std::clamp<std::size_t>(limit, 1, max_limit);
+
+        auto page = TodoManager::range_page(from ? parse_timestamp_param(*from) : 0,
+                                            to ? parse_timestamp_param(*to) : UINT64_MAX,
+                                            limit,
+                                            cursor ? std::optional<Todo>(decode_cursor(*cursor)) : std::nullopt);
+
+        write_json(res, [&](auto& out) {
+            out += "{\"todos\":";
+            json_writer::append_todos(out, page.todos);
+            out += ",\"next_cursor\":";
+            if (page.more) append_cursor(out, page.todos.back());
+            else out += "null";
+            out += '}';
+        });
     } catch (const std::exception& e) {
         set_json(res, {{"error", e.what()}}, 400);
     }
 }
 
-REGISTER_VIEW(todo_delete) {
-    if (!check_method(req, http_util::http::verb::delete_, res)) return;
+// Todos whose name starts with `prefix` and/or contains `contains` (percent-decoded), in name
+// order, paged like todo_range
+REGISTER_VIEW(todo_search, get) {
+    constexpr std::size_t default_limit = 100;
+    constexpr std::size_t max_limit = 10000;
 
+    try {
+        const auto prefix_param = get_query_param(req, "prefix");
+        const auto contains_param = get_query_param(req, "contains");
+        const auto limit_param = get_query_param(req, "limit");
+        const auto cursor = get_query_param(req, "cursor");
+        if (!prefix_param && !contains_param) {
+            set_json(res, {{"error", "Missing 'prefix' or 'contains' parameter"}}, 400);
+            return;
+        }
+
+        std::pmr::memory_resource* arena = http_util::resource_of(req);
+        const std::pmr::string prefix = http_util::percent_decode(prefix_param.value_or(""), arena);
+        const std::optional<std::pmr::string> contains =
+                contains_param ? std::optional(http_util::percent_decode(*contains_param, arena)) : std::nullopt;
+        std::size_t limit = limit_param ? parse_number_param<std::size_t>(*limit_param, "Invalid limit") : default_limit;
+        limit = std::clamp<std::size_t>(limit, 1, max_limit);
+
+        auto page = TodoManager::search(prefix,
+                                        contains ? std::optional<std::string_view>(*contains) : std::nullopt,
+                                        limit,
+                                        cursor ? std::optional<Todo>(decode_cursor(*cursor)) : std::nullopt);
+
+        write_json(res, [&](auto& out) {
+            out += "{\"todos\":";
+            json_writer::append_todos(out, page.todos);
+            out += ",\"next_cursor\":";
+            if (page.more) append_cursor(out, page.todos.back());
+            else out += "null";
+            out += '}';
+        });
+    } catch (const std::exception& e) {
+        set_json(res, {{"error", e.what()}}, 400);
+    }
+}
+
+// Todos carrying `tag` and / or of priority `min_priority` and up, due in [from, to), highest
+// priority first, then by due date and name; paged like todo_range
+REGISTER_VIEW(todo_query, get) {
+    constexpr std::size_t default_limit = 100;
+    constexpr std::size_t max_limit = 10000;
+
+    try {
+        const auto tag_param = get_query_param(req, "tag");
+        const auto priority_param = get_query_param(req, "min_priority");
+        const auto from = get_query_param(req, "from");
+        const auto to = get_query_param(req, "to");
+        const auto limit_param = get_query_param(req, "limit");
+        const auto cursor = get_query_param(req, "cursor");
+
+        const std::optional<std::pmr::string> tag =
+                tag_param ? std::optional(http_util::percent_decode(*tag_param, http_util::resource_of(req))) : std::nullopt;
+        TodoManager::Filter filter;
+        if (tag) filter.tag = *tag;
+        filter.min_priority = priority_param ? parse_number_param<uint8_t>(*priority_param, "Invalid min_priority") : 0;
+        filter.from = from ? parse_timestamp_param(*from) : 0;
+        filter.to = to ? parse_timestamp_param(*to) : UINT64_MAX;
+        std::size_t limit = limit_param ? parse_number_param<std::size_t>(*limit_param, "Invalid limit") : default_limit;
+        limit = std::clamp<std::size_t>(limit, 1, max_limit);
+
+        auto page = TodoManager::query(filter, limit,
+                                       cursor ? std::optional<Todo>(decode_priority_cursor(*cursor)) : std::nullopt);
+
+        write_json(res, [&](auto& out) {
+            out += "{\"todos\":";
+            json_writer::append_todos(out, page.todos);
+            out += ",\"next_cursor\":";
+            if (page.more) append_priority_cursor(out, page.todos.back());
+            else out += "null";
+            out += '}';
+        });
+    } catch (const std::exception& e) {
+        set_json(res, {{"error", e.what()}}, 400);
+    }
+}
+
+inline std::string_view change_name(ChangeLog::Kind kind) {
+    switch (kind) {
+        case ChangeLog::Kind::create: return "create";
+        case ChangeLog::Kind::upsert: return "upsert";
+        case ChangeLog::Kind::erase: return "delete";
+        case ChangeLog::Kind::expire: return "expire";
+        case ChangeLog::Kind::erase_before: return "erase_before";
+        case ChangeLog::Kind::clear: return "clear";
+        case ChangeLog::Kind::resync: return "resync";
+    }
+    return "unknown";
+}
+
+// Changes after `since` (default: none, from now on), oldest first. With wait=<seconds>
+// an empty answer is held back until a change arrives or the time is up (long poll).
+REGISTER_VIEW(todo_changes, get) {
+    constexpr std::size_t default_limit = 1000;
+    constexpr std::size_t max_limit = 10000;
+    constexpr unsigned max_wait = 60;
+
+    auto& changes = TodoManager::changes();
+    if (!changes.enabled()) {
+        set_json(res, {{"error", "The change feed is not configured"}}, 400);
+        return;
+    }
+
+    uint64_t since;
+    std::size_t limit;
+    unsigned wait;
+    try {
+        const auto since_param = get_query_param(req, "since");
+        const auto limit_param = get_query_param(req, "limit");
+        const auto wait_param = get_query_param(req, "wait");
+        since = since_param ? parse_number_param<uint64_t>(*since_param, "Invalid since") : changes.head();
+        limit = std::clamp<std::size_t>(limit_param ? parse_number_param<std::size_t>(*limit_param, "Invalid limit") : default_limit,
+                                        1, max_limit);
+        wait = std::min(wait_param ? parse_number_param<unsigned>(*wait_param, "Invalid wait") : 0u, max_wait);
+    } catch (const std::exception& e) {
+        set_json(res, {{"error", e.what()}}, 400);
+        return;
+    }
+
+    std::vector<ChangeLog::Change> list;
+    uint64_t next;
+    if (changes.read(since, limit, list, next) == ChangeLog::ReadStatus::resync) {
+        // the client reloads /todo_all and continues from next
+        write_json(res, [&](auto& out) {
+            out += "{\"error\":\"Changes are no longer available, resync\",\"resync\":true,\"next\":";
+            json_writer::append_number(out, next);
+            out += '}';
+        }, 410);
+        return;
+    }
+
+    write_json(res, [&](auto& out) {
+        out.reserve(list.size() * 96 + 32);
+        out += "{\"changes\":[";
+        for (std::size_t i = 0; i < list.size(); ++i) {
+            const auto& change = list[i];
+            if (i) out += ',';
+            out += "{\"seq\":";
+            json_writer::append_number(out, change.seq);
+            out += ",\"op\":\"";
+            out += change_name(change.kind);
+            out += '"';
+            if (change.kind == ChangeLog::Kind::erase_before) {
+                out += ",\"before\":\"";
+                append_iso_timestamp(out, change.todo.due_timestamp);
+                out += '"';
+            } else if (change.kind != ChangeLog::Kind::clear) {
+                out += ",\"todo\":";
+                json_writer::append_todo(out, change.todo);
+            }
+            out += '}';
+        }
+        out += "],\"next\":";
+        json_writer::append_number(out, next);
+        out += '}';
+    });
+
+    if (list.empty() && wait > 0) {
+        // woken up, a request without since must read from the head it saw, not the head after the change
+        std::string pinned;
+        if (!get_query_param(req, "since")) {
+            const std::string_view target = req.target();
+            pinned.assign(target).append(target.find('?') == std::string_view::npos ? "?since=" : "&since=").append(std::to_string(since));
+        }
+        res.body().wait = http_util::Wait{
+                std::chrono::seconds(wait),
+                [since](std::function<void()> notify) { return TodoManager::changes().subscribe(since, std::move(notify)); },
+                [](std::uint64_t id) { TodoManager::changes().unsubscribe(id); },
+                std::move(pinned)};
+    }
+}
+
+// /todo_batch binary records, host byte order (little-endian on supported targets)
+struct BatchRecord {
+    uint8_t op;          // 0 create, 1 get, 2 delete, 3 upsert
+    uint8_t reserved[7];
+    uint64_t due_timestamp;
+    char name[64];       // zero padded, at most 63 bytes
+};
+
+struct BatchResultRecord {
+    uint8_t status;      // 0 created, 1 exists, 2 found, 3 not_found, 4 deleted, 5 updated
+    uint8_t reserved[7];
+    uint64_t due_timestamp;
+};
+
+static_assert(sizeof(BatchRecord) == 80 && sizeof(BatchResultRecord) == 16);
+
+inline std::vector<TodoManager::Operation> parse_batch_json(const Request& req) {
+    using Kind = TodoManager::Operation::Kind;
+    const auto value = http_util::parse_json(req);
+    const auto& items = value.is_object() ? value.as_object().at("ops").as_array() : value.as_array();
+
+    std::vector<TodoManager::Operation> ops;
+    ops.reserve(items.size());
+    for (const auto& item : items) {
+        const auto& obj = item.as_object();
+        const std::string_view op = obj.at("op").as_string();
+        Kind kind;
+        if (op == "create") kind = Kind::create;
+        else if (op == "get") kind = Kind::get;
+        else if (op == "delete") kind = Kind::erase;
+        else if (op == "upsert") kind = Kind::upsert;
+        else throw std::invalid_argument("Unknown op: " + std::string(op));
+        ops.push_back({kind, parse_todo_from_json(obj)});
+    }
+    return ops;
+}
+
+inline std::vector<TodoManager::Operation> parse_batch_binary(std::string_view body) {
+    if (body.size() % sizeof(BatchRecord) != 0) throw std::invalid_argument("Truncated batch record");
+
+    std::vector<TodoManager::Operation> ops(body.size() / sizeof(BatchRecord));
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+        BatchRecord record;
+        std::memcpy(&record, body.data() + i * sizeof(BatchRecord), sizeof(BatchRecord));
+        if (record.op > 3) throw std::invalid_argument("Unknown op");
+        if (record.name[0] == '\0' || record.name[63] != '\0') throw std::invalid_argument("Invalid name");
+
+        ops[i].kind = static_cast<TodoManager::Operation::Kind>(record.op);
+        // only the name itself: bytes after its terminator stay zero, as keys compare all 64
+        std::memcpy(ops[i].todo.name.data, record.name, strnlen(record.name, sizeof(record.name)));
+        ops[i].todo.due_timestamp = record.due_timestamp;
+    }
+    return ops;
+}
+
+inline std::string_view status_name(TodoManager::OperationResult::Status status) {
+    using Status = TodoManager::OperationResult::Status;
+    switch (status) {
+        case Status::created: return "created";
+        case Status::exists: return "exists";
+        case Status::found: return "found";
+        case Status::not_found: return "not_found";
+        case Status::deleted: return "deleted";
+        case Status::updated: return "updated";
+    }
+    return "unknown";
+}
+
+REGISTER_VIEW(todo_batch, post) {
+    const bool binary = req[http_util::http::field::content_type].starts_with("application/octet-stream");
+
+    std::vector<TodoManager::Operation> ops;
+    try {
+        ops = binary ? parse_batch_binary(req.body()) : parse_batch_json(req);
+    } catch (const std::exception& e) {
+        set_json(res, {{"error", e.what()}}, 400);
+        return;
+    }
+
+    const auto results = TodoManager::apply_batch(ops);
+
+    if (binary) {
+        auto& out = res.body().data;
+        out.assign(results.size() * sizeof(BatchResultRecord), '\0');
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            BatchResultRecord record{};
+            record.status = static_cast<uint8_t>(results[i].status);
+            record.due_timestamp = results[i].details.due_timestamp;
+            std::memcpy(out.data() + i * sizeof(BatchResultRecord), &record, sizeof(record));
+        }
+        res.result(http_util::http::status::ok);
+        res.set(http_util::http::field::content_type, "application/octet-stream");
+        res.prepare_payload();
+        return;
+    }
+
+    write_json(res, [&](auto& out) {
+        out.reserve(results.size() * 24 + 16);
+        out += "{\"results\":[";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            if (i) out += ',';
+            out += "{\"status\":\"";
+            out += status_name(results[i].status);
+            out += '"';
+            if (results[i].status == TodoManager::OperationResult::Status::found) {
+                out += ",\"todo\":";
+                json_writer::append_todo(out, Todo::make(ops[i].todo.name, results[i].details));
+            }
+            out += '}';
+        }
+        out += "]}";
+    });
+}
+
+REGISTER_VIEW(todo_delete, delete_) {
     std::string_view name = req[http_util::http::field::authorization];
     if (name.empty()) {
         set_json(res, {{"error", "Missing 'name' header"}}, 400);
@@ -175,48 +531,125 @@ REGISTER_VIEW(todo_delete) {
 }
 
 
-REGISTER_VIEW(todo_erase) {
-    if (!check_method(req, http_util::http::verb::post, res)) return;
-
+REGISTER_VIEW(todo_erase, post) {
     try {
-        auto obj = json::parse(req.body()).as_object();
-        uint64_t ts = parse_timestamp_field(obj.at("before"));
+        const auto value = http_util::parse_json(req);
+        uint64_t ts = parse_timestamp_field(value.as_object().at("before"));
         TodoManager::erase_expired(ts);
         set_json(res, {{"status", "done"}});
+    } catch (const JournalFailed& e) {
+        set_json(res, {{"error", e.what()}}, 503);
     } catch (const std::exception& e) {
         set_json(res, {{"error", e.what()}}, 400);
     }
 }
 
-REGISTER_VIEW(todo_import) {
-    if (!check_method(req, http_util::http::verb::post, res)) return;
-
+REGISTER_VIEW(todo_import, post) {
     try {
-        bool clear = true;
+        const auto started = std::chrono::steady_clock::now();
+        bool clear = CsvImportBody::clear_before(req.target());
+        std::size_t rows;
 
         if (http_util::is_json(req)) {
-            auto obj = boost::json::parse(req.body()).as_object();
+            const auto value = http_util::parse_json(req);
+            const auto& obj = value.as_object();
             if (obj.contains("clear_before") && obj.at("clear_before").is_bool()) {
                 clear = obj.at("clear_before").as_bool();
             }
-            std::istringstream csv_stream(obj.contains("csv") ? obj.at("csv").as_string().c_str() : "");
-            TodoManager::load_from_csv(csv_stream, clear);
+            rows = TodoManager::load_from_csv(obj.contains("csv") ? std::string_view(obj.at("csv").as_string()) : "", clear);
         } else {
-            std::istringstream ss(req.body());
-            TodoManager::load_from_csv(ss, clear);
+            rows = TodoManager::load_from_csv(std::string_view(req.body()), clear);
         }
+        Metrics::instance().record_import(std::chrono::steady_clock::now() - started);
 
-        set_json(res, {{"status", "imported"}});
+        set_json(res, {{"status", "imported"}, {"rows", rows}});
+    } catch (const JournalFailed& e) {
+        set_json(res, {{"error", e.what()}}, 503);
     } catch (...) {
         set_json(res, {{"error", "Failed to import"}}, 400);
     }
 }
 
+void views::todo_import_streamed(const CsvImportBody::value_type& body, Response& res) {
+    Metrics::instance().record_import(std::chrono::steady_clock::now() - body.started);
+    if (body.job->journal_failed()) {
+        set_json(res, {{"error", body.job->error()}}, 503);
+        return;
+    }
+    if (!body.job->error().empty()) {
+        set_json(res, {{"error", "Failed to import"}, {"detail", body.job->error()}}, 400);
+        return;
+    }
+    set_json(res, {{"status", "imported"}, {"rows", body.job->rows()}});
+}
+
+
+REGISTER_VIEW(todo_export, get) {
+    auto& cache = ResponseCache::instance();
+    const auto generation = TodoManager::generation();
+    if (http_util::not_modified(req, res, cache.etag(generation))) return;
+
+    if (auto body = cache.find(ResponseCache::Kind::export_csv, generation)) {
+        set_csv::apply(res, std::move(body), "todos.csv");
+        return;
+    }
+
+    // streamed as it is produced; a copy is kept for the cache unless it grows past the limit
+    set_csv::stream(res, [cursor = TodoManager::csv_export(), started = std::chrono::steady_clock::now(),
+                          generation, copy = std::string(), keep = true](std::string& chunk) mutable {
+        const std::size_t from = chunk.size();
+        const bool more = cursor.next(chunk);
+        if (keep && copy.size() + (chunk.size() - from) <= ResponseCache::max_body_bytes) {
+            copy.append(chunk, from);
+        } else if (keep) {
+            keep = false;
+            std::string().swap(copy);
+        }
+        if (more) return true;
 
-REGISTER_VIEW(todo_export) {
-    if (!check_method(req, http_util::http::verb::get, res)) return;
+        Metrics::instance().record_export(std::chrono::steady_clock::now() - started);
+        if (keep && TodoManager::generation() == generation) {
+            ResponseCache::instance().store(ResponseCache::Kind::export_csv, generation,
+                                            std::make_shared<const std::string>(std::move(copy)));
+        }
+        return false;
+    }, "todos.csv");
+}
 
-    std::ostringstream ss;
-    TodoManager::save_to_csv(ss);
-    set_csv::apply(res, ss.str(), "todos.csv");
+REGISTER_VIEW(todo_snapshot, post) {
+    switch (TodoManager::checkpoint()) {
+        case TodoManager::CheckpointResult::started:
+            set_json(res, {{"status", "snapshot_started"}}, 202);
+            break;
+        case TodoManager::CheckpointResult::busy:
+            set_json(res, {{"error", "Snapshot already in progress"}}, 409);
+            break;
+        case TodoManager::CheckpointResult::disabled:
+            set_json(res, {{"error", "Snapshots are not configured"}}, 400);
+            break;
+    }
+}
+
+REGISTER_VIEW(metrics, get) {
+    std::string out;
+    Metrics::instance().render(out);
+
+    const auto locks = TodoManager::lock_stats();
+    out += "# HELP todo_repository_size Todos in the store.\n"
+           "# TYPE todo_repository_size gauge\n";
+    Metrics::line(out, "todo_repository_size", "", static_cast<uint64_t>(TodoManager::size()));
+    out += "# HELP todo_repository_lock_waits_total Shard lock acquisitions that had to wait.\n"
+           "# TYPE todo_repository_lock_waits_total counter\n";
+    Metrics::line(out, "todo_repository_lock_waits_total", "", locks.waits);
+    out += "# HELP todo_repository_lock_wait_seconds_total Time spent waiting for shard locks.\n"
+           "# TYPE todo_repository_lock_wait_seconds_total counter\n";
+    Metrics::line(out, "todo_repository_lock_wait_seconds_total", "", static_cast<double>(locks.wait_ns) * 1e-9);
+    out += "# HELP todo_journal_failed 1 once the write-ahead log has failed and writes are refused.\n"
+           "# TYPE todo_journal_failed gauge\n";
+    Metrics::line(out, "todo_journal_failed", "", uint64_t{TodoManager::journal_failed()});
+
+    res.result(http_util::http::status::ok);
+    res.set(http_util::http::field::content_type, "text/plain; version=0.0.4");
+    res.body().data.assign(out);
+    res.prepare_payload();
 }
@@ -1,22 +1,31 @@
 #pragma once
 
-#include <string>
-#include <unordered_map>
+#include <vector>
 #include "HttpUtils.hpp"
+#include "CsvImportBody.hpp"
 
 namespace views {
 
     using HandlerFunc = void (*)(const http_util::Request& req, http_util::Response& res);
 
-    // Declare global function map
-    extern std::unordered_map<std::string, HandlerFunc> function_map;
+    struct View {
+        const char* path;
+        http_util::http::verb method;
+        HandlerFunc func;
+    };
 
-    // Macro for auto-registering views
-    #define REGISTER_VIEW(name) \
+    // Every view, filled by REGISTER_VIEW at static initialization
+    extern std::vector<View> registry;
+
+    // Answers a /todo_import whose CSV body was parsed while it arrived
+    void todo_import_streamed(const CsvImportBody::value_type& body, http_util::Response& res);
+
+    // Macro for auto-registering views; the router only calls `name` for `/name` with this method
+    #define REGISTER_VIEW(name, method) \
         void name(const http_util::Request& req, http_util::Response& res); \
         struct name##_registrar { \
-            name##_registrar() { views::function_map[#name] = name; } \
+            name##_registrar() { views::registry.push_back({"/" #name, http_util::http::verb::method, name}); } \
         } name##_registrar_instance; \
-        void name(const http_util::Request& req, http_util::Response& res)
+        void name([[maybe_unused]] const http_util::Request& req, http_util::Response& res)
 
 }
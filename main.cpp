@@ -3,14 +3,22 @@
 #include <boost/asio.hpp>
 #include <boost/json.hpp>
 #include <iostream>
-#include <unordered_map>
-#include <sstream>
 #include <thread>
-#include <csignal>
 #include <atomic>
 #include <vector>
-#include <mutex>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <sys/socket.h>
 #include "Web/views.h"
+#include "Web/Router.hpp"
+#include "Web/Metrics.hpp"
+#include "Web/Compression.hpp"
+#include "Application/TodoManager.hpp"
 
 
 namespace beast = boost::beast;
@@ -21,144 +29,516 @@ namespace json = boost::json;
 using tcp = boost::asio::ip::tcp;
 
 std::atomic g_should_exit = false;
-std::unique_ptr<tcp::acceptor> global_acceptor;
-
-std::vector<std::thread> session_threads;
-std::mutex session_mutex;
-
-void handle_signal(const int signal) {
-    if (signal == SIGTERM || signal == SIGINT) {
-        if (global_acceptor) {
-            boost::system::error_code ec;
-            auto err = global_acceptor->cancel(ec);
-            (void) err;
-        }
-    }
-}
 
 void cleanup() {
     // Used to clean up existing connections
 }
 
-std::unordered_map<std::string, views::HandlerFunc> build_route_map() {
-    std::unordered_map<std::string, views::HandlerFunc> map;
-    for (const auto &[name, func]: views::function_map) {
-        map["/" + name] = func;
+// Server settings, overridable through the environment (see build.md)
+struct ServerConfig {
+    unsigned short port = 8080;
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool reuse_port = false; // one SO_REUSEPORT acceptor + io_context per thread
+    std::chrono::seconds idle_timeout{15};  // waiting for the next request on a kept-alive connection
+    std::chrono::seconds read_timeout{30};  // receiving the rest of a request once its header started
+    std::size_t max_requests = 1000;        // requests served per connection before it is closed
+    std::uint64_t body_limit = 1 << 20;     // largest buffered request body
+    std::size_t arena_bytes = RequestArena::default_max_bytes; // per-connection request memory kept between requests
+    std::optional<std::uint64_t> import_limit = std::uint64_t{64} << 30; // streamed CSV import, unset = unlimited
+    std::size_t shards = 0;                 // repository lock stripes, 0 keeps the repository default
+    std::size_t change_log = 0;             // changes kept for /todo_changes, 0 turns the change feed off
+    std::optional<WriteAheadLog::Options> wal; // journal file and its sync policy, off when unset
+    std::optional<std::string> snapshot;       // binary snapshot loaded at startup and written at exit
+    std::optional<std::chrono::seconds> expiry_grace;    // background removal of todos this long past due, off when unset
+    std::chrono::milliseconds expiry_interval{1000};     // between expiry passes
+    compression::Settings compression;                    // gzip / deflate of text and JSON responses
+
+    static ServerConfig from_env() {
+        ServerConfig config;
+        if (const char *v = std::getenv("TODO_PORT")) config.port = static_cast<unsigned short>(std::stoul(v));
+        if (const char *v = std::getenv("TODO_THREADS")) config.threads = std::max<std::size_t>(1, std::stoul(v));
+        if (const char *v = std::getenv("TODO_REUSE_PORT")) config.reuse_port = std::string_view(v) == "1";
+        if (const char *v = std::getenv("TODO_IDLE_TIMEOUT")) config.idle_timeout = std::chrono::seconds(std::stoul(v));
+        if (const char *v = std::getenv("TODO_READ_TIMEOUT")) config.read_timeout = std::chrono::seconds(std::stoul(v));
+        if (const char *v = std::getenv("TODO_MAX_REQUESTS")) config.max_requests = std::max<std::size_t>(1, std::stoul(v));
+        if (const char *v = std::getenv("TODO_SHARDS")) config.shards = std::stoul(v);
+        if (const char *v = std::getenv("TODO_CHANGE_LOG")) config.change_log = std::stoul(v);
+        if (const char *v = std::getenv("TODO_BODY_LIMIT")) config.body_limit = std::stoull(v);
+        if (const char *v = std::getenv("TODO_ARENA_BYTES")) config.arena_bytes = std::stoull(v);
+        if (const char *v = std::getenv("TODO_IMPORT_LIMIT")) {
+            config.import_limit = std::stoull(v);
+            if (*config.import_limit == 0) config.import_limit.reset();
+        }
+        if (const char *v = std::getenv("TODO_WAL")) {
+            config.wal.emplace().path = v;
+            if (const char *p = std::getenv("TODO_WAL_SYNC")) config.wal->policy = WriteAheadLog::parse_policy(p);
+            if (const char *ms = std::getenv("TODO_WAL_INTERVAL_MS")) {
+                config.wal->interval = std::chrono::milliseconds(std::max<unsigned long>(1, std::stoul(ms)));
+            }
+        }
+        if (const char *v = std::getenv("TODO_SNAPSHOT")) config.snapshot = v;
+        if (const char *v = std::getenv("TODO_EXPIRY_GRACE")) config.expiry_grace = std::chrono::seconds(std::stoul(v));
+        if (const char *v = std::getenv("TODO_EXPIRY_INTERVAL_MS")) {
+            config.expiry_interval = std::chrono::milliseconds(std::max<unsigned long>(1, std::stoul(v)));
+        }
+        if (const char *v = std::getenv("TODO_COMPRESS_MIN_BYTES")) config.compression.min_bytes = std::stoull(v);
+        if (const char *v = std::getenv("TODO_COMPRESS_LEVEL")) config.compression.level = std::clamp(std::stoi(v), 0, 9);
+        return config;
     }
-    return map;
-}
+};
 
-void handle_request(
-        const std::unordered_map<std::string, views::HandlerFunc> &route_map,
-        const http::request<http::string_body> &req,
-        http::response<http::string_body> &res) {
+// Returns the metrics series of the request. A held-back long poll (res.body().wait) is not
+// recorded here but by the session, once it is answered.
+std::size_t handle_request(
+        const Router &router,
+        const compression::Settings &compress,
+        const http_util::Request &req,
+        http_util::Response &res,
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now()) {
 
     res.version(req.version());
     res.keep_alive(req.keep_alive());
 
-    const std::string target = std::string(req.target());
-    auto query_pos = target.find('?');
-    std::string route = query_pos == std::string::npos ? target : target.substr(0, query_pos);
+    const std::string_view target = req.target();
+    const std::string_view path = target.substr(0, target.find('?'));
 
-    if (auto it = route_map.find(route); it != route_map.end()) {
-        http_util::Response hres;
+    const auto match = router.find(req.method(), path);
+    if (match.status == Router::Status::found) {
+        http_util::Response hres = http_util::make_response(http_util::resource_of(res));
         try {
-            it->second(req, hres);
+            match.handler(req, hres);
+        } catch (const JournalFailed& e) {
+            http_util::set_json(hres, {{"error", e.what()}}, 503);
         } catch (const std::exception& e) {
             http_util::set_json(hres, {{"error", e.what()}}, 400);
         }
+        compression::apply(req, hres, compress);
+        hres.version(req.version());
+        hres.keep_alive(req.keep_alive());
+        if (hres.body().producer && req.version() < 11) {
+            // HTTP/1.0 has no chunked encoding: the body ends when the connection closes
+            hres.chunked(false);
+            hres.keep_alive(false);
+        }
         res = std::move(hres);
+    } else if (match.status == Router::Status::method_not_allowed) {
+        std::vector<http::verb> allowed;
+        for (const auto &endpoint: match.route->methods) allowed.push_back(endpoint.method);
+        http_util::set_method_not_allowed(res, allowed, req.method());
     } else {
-        http_util::set_text(res, "404 Not Found: " + route, 404);
+        std::pmr::string text("404 Not Found: ", http_util::resource_of(res));
+        text += path;
+        http_util::set_text(res, text, 404);
     }
 
+    const std::size_t series = match.status == Router::Status::found ? match.id : Metrics::unmatched;
+    if (!res.body().wait) {
+        Metrics::instance().record_request(series, res.result_int(), std::chrono::steady_clock::now() - started);
+    }
+    return series;
 }
 
 
-void do_session(tcp::socket socket,
-                const std::shared_ptr<const std::unordered_map<std::string, views::HandlerFunc>> &route_map) {
-    try {
-        beast::flat_buffer buffer;
-        http::request<http::string_body> req;
-        http::read(socket, buffer, req);
+// A connection's strand by its concrete type: a type-erased one (any_io_executor) is
+// copied to the heap by every asynchronous operation started on it
+using Strand = net::strand<net::io_context::executor_type>;
+using Stream = beast::basic_stream<tcp, Strand>;
+
+// One connection: reads requests in order while keep-alive holds, so pipelined
+// requests are answered in sequence from the same buffer. Each request is parsed and
+// answered in the connection's arena, which is reset before the next one is read.
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(Stream::socket_type &&socket, const ServerConfig &config, std::shared_ptr<const Router> router)
+            : stream_(std::move(socket)), config_(config), router_(std::move(router)), arena_(config.arena_bytes),
+              poll_timer_(stream_.get_executor()) {
+        Metrics::instance().connection_opened();
+    }
 
-        http::response<http::string_body> res;
-        handle_request(*route_map, req, res);
+    ~Session() {
+        Metrics::instance().connection_closed();
+    }
 
-        http::write(socket, res);
-    } catch (const beast::system_error &e) {
-        if (!g_should_exit && e.code() != http::error::partial_message) {
-            std::cerr << "Session error: " << e.what() << std::endl;
+    void run() {
+        // sockets are accepted on a strand, enter it before the first operation
+        net::dispatch(stream_.get_executor(), beast::bind_front_handler(&Session::do_read, shared_from_this()));
+    }
+
+private:
+    Stream stream_;
+    beast::flat_buffer buffer_;
+    const ServerConfig &config_;
+    std::shared_ptr<const Router> router_;
+    RequestArena arena_; // holds the request and response below, so it is declared first
+    std::optional<http::request_parser<http_util::Request::body_type, http_util::Allocator>> parser_;
+    std::optional<http::request_parser<CsvImportBody, http_util::Allocator>> import_parser_;
+    std::optional<http_util::Response> res_;
+    http::response<http::empty_body> continue_;
+    std::size_t served_ = 0;
+
+    // a long poll in progress: res_ holds the answer for its timeout
+    net::steady_timer::rebind_executor<Strand>::other poll_timer_;
+    std::chrono::steady_clock::time_point poll_started_;
+    std::size_t poll_series_ = 0;
+    std::uint64_t poll_subscription_ = 0;
+    std::uint64_t poll_round_ = 0; // tells the current wake-up from stale ones
+
+    void do_read() {
+        // the last request and its answer are done with: drop them, then their memory
+        parser_.reset();
+        import_parser_.reset();
+        res_.reset();
+        arena_.reset();
+
+        parser_.emplace(std::piecewise_construct, std::make_tuple(&arena_), std::make_tuple(http_util::Allocator(&arena_)));
+        parser_->body_limit(std::numeric_limits<std::uint64_t>::max()); // applied per route once the header is known
+        stream_.expires_after(config_.idle_timeout);
+        http::async_read_header(stream_, buffer_, *parser_,
+                                beast::bind_front_handler(&Session::on_header, shared_from_this()));
+    }
+
+    void on_header(beast::error_code ec, std::size_t) {
+        // peer closed or went quiet between requests: a normal end of a kept-alive connection
+        if (ec == http::error::end_of_stream || (ec == beast::error::timeout && buffer_.size() == 0)) {
+            return do_close();
         }
-        // Force shutdown silently
-    } catch (const std::exception &e) {
-        if (!g_should_exit) {
-            std::cerr << "Session exception: " << e.what() << std::endl;
+        if (ec) return fail(ec, "read");
+
+        if (CsvImportBody::accepts(parser_->get())) {
+            if (config_.import_limit && exceeds(*config_.import_limit)) return reject_body();
+            return continue_then(&Session::read_import);
         }
+        if (exceeds(config_.body_limit)) return reject_body();
+        parser_->body_limit(config_.body_limit);
+
+        if (parser_->is_done()) return on_read({}, 0);
+        continue_then(&Session::read_body);
     }
-}
 
+    // clients holding their body back for `Expect: 100-continue` get the interim response first
+    void continue_then(void (Session::*next)()) {
+        if (!beast::iequals(parser_->get()[http::field::expect], "100-continue")) return (this->*next)();
 
-int main() {
-    std::signal(SIGINT, handle_signal);
-    std::signal(SIGTERM, handle_signal);
-    std::atexit(cleanup);
+        continue_ = {http::status::continue_, parser_->get().version()};
+        stream_.expires_after(config_.read_timeout);
+        http::async_write(stream_, continue_, [self = shared_from_this(), next](beast::error_code ec, std::size_t) {
+            if (ec) return fail(ec, "write");
+            ((*self).*next)();
+        });
+    }
 
-    auto route_map = std::make_shared<std::unordered_map<std::string, views::HandlerFunc>>(build_route_map());
-    std::cout << "Registered routes:" << std::endl;
-    for (const auto &[name, _]: *route_map) {
-        std::cout << name << std::endl;
+    void read_body() {
+        stream_.expires_after(config_.read_timeout);
+        http::async_read(stream_, buffer_, *parser_, beast::bind_front_handler(&Session::on_read, shared_from_this()));
     }
 
-    try {
-        net::io_context ioc{1};
-        global_acceptor = std::make_unique<tcp::acceptor>(ioc, tcp::endpoint{tcp::v4(), 8080});
+    void on_read(beast::error_code ec, std::size_t) {
+        if (ec == http::error::body_limit) return reject_body();
+        if (ec) return fail(ec, "read");
+
+        res_.emplace(http_util::make_response(&arena_));
+        poll_started_ = std::chrono::steady_clock::now();
+        try {
+            poll_series_ = handle_request(*router_, config_.compression, parser_->get(), *res_, poll_started_);
+        } catch (const std::exception &e) {
+            if (!g_should_exit) std::cerr << "Session exception: " << e.what() << std::endl;
+            return do_close();
+        }
+        if (res_->body().wait) return start_poll();
+        send();
+    }
+
+    // Nothing to answer yet: wait for the view's subscription or the timeout, whichever is first
+    void start_poll() {
+        poll_timer_.expires_after(res_->body().wait->timeout);
+        poll_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec) self->end_poll();
+        });
+        subscribe_poll();
+    }
+
+    void subscribe_poll() {
+        const std::uint64_t round = ++poll_round_;
+        poll_subscription_ = res_->body().wait->subscribe([weak = weak_from_this(), round] {
+            // runs on the thread that made the change: hop onto this session's strand
+            if (auto self = weak.lock()) {
+                net::post(self->stream_.get_executor(), [self, round] { self->on_wake(round); });
+            }
+        });
+    }
+
+    void on_wake(std::uint64_t round) {
+        if (round != poll_round_ || !res_->body().wait) return;
+
+        if (!res_->body().wait->target.empty()) parser_->get().target(res_->body().wait->target);
+        res_.emplace(http_util::make_response(&arena_));
+        try {
+            handle_request(*router_, config_.compression, parser_->get(), *res_, poll_started_);
+        } catch (const std::exception &e) {
+            if (!g_should_exit) std::cerr << "Session exception: " << e.what() << std::endl;
+            return do_close();
+        }
+        if (res_->body().wait) return subscribe_poll(); // woken for nothing this request can see
+        poll_timer_.cancel();
+        send();
+    }
+
+    // timed out: send the empty answer prepared with the wait
+    void end_poll() {
+        if (!res_->body().wait) return;
+        res_->body().wait->unsubscribe(poll_subscription_);
+        res_->body().wait.reset();
+        ++poll_round_;
+        Metrics::instance().record_request(poll_series_, res_->result_int(), std::chrono::steady_clock::now() - poll_started_);
+        send();
+    }
+
+    // A CSV upload is read piece by piece under its own body limit and parsed on the import's
+    // worker; reading pauses while the worker is behind, so memory stays bounded
+    void read_import() {
+        import_parser_.emplace(std::move(*parser_));
+        parser_.reset();
+        import_parser_->body_limit(config_.import_limit.value_or(std::numeric_limits<std::uint64_t>::max()));
+        auto &body = import_parser_->get().body();
+        body.started = std::chrono::steady_clock::now();
+        body.job = std::make_unique<CsvImportBody::Job>(CsvImportBody::clear_before(import_parser_->get().target()));
+        if (import_parser_->is_done()) return on_import_read({}, 0); // an empty body
+        read_import_some();
+    }
+
+    void read_import_some() {
+        stream_.expires_after(config_.read_timeout);
+        http::async_read_some(stream_, buffer_, *import_parser_,
+                              beast::bind_front_handler(&Session::on_import_read, shared_from_this()));
+    }
+
+    void on_import_read(beast::error_code ec, std::size_t) {
+        if (ec == http::error::body_limit) return reject_body();
+        if (ec) return fail(ec, "read");
+
+        auto &job = *import_parser_->get().body().job;
+        if (import_parser_->is_done()) {
+            job.close();
+            return job.when_done(on_strand(&Session::on_import_done));
+        }
+        if (job.backlogged(on_strand(&Session::read_import_some))) return;
+        read_import_some();
+    }
 
-        auto io_runner = [&ioc]() {
-            ioc.run();
+    void on_import_done() {
+        const auto &req = import_parser_->get();
+        res_.emplace(http_util::make_response(&arena_));
+        views::todo_import_streamed(req.body(), *res_);
+        if (const auto match = router_->find(req.method(), "/todo_import"); match.status == Router::Status::found) {
+            Metrics::instance().record_request(match.id, res_->result_int(), std::chrono::steady_clock::now() - req.body().started);
+        }
+        res_->version(req.version());
+        res_->keep_alive(req.keep_alive());
+        import_parser_.reset();
+        send();
+    }
+
+    // A callback for the import worker: the step runs on this session's strand, and the worker
+    // hands its reference over rather than dropping it (the job it would join is ours)
+    std::function<void()> on_strand(void (Session::*step)()) {
+        return [self = shared_from_this(), step]() mutable {
+            const auto executor = self->stream_.get_executor();
+            net::post(executor, [self = std::move(self), step] { ((*self).*step)(); });
         };
-        std::thread(std::move(io_runner)).detach();
+    }
+
+    // a declared Content-Length over the limit; chunked bodies are cut off by the parser instead
+    bool exceeds(std::uint64_t limit) const {
+        const auto length = parser_->content_length();
+        return length && *length > limit;
+    }
+
+    // the rest of the oversized body is never read, so the connection cannot be reused
+    void reject_body() {
+        res_.emplace(http_util::make_response(&arena_));
+        http_util::set_json(*res_, {{"error", "Request body too large"}}, 413);
+        res_->keep_alive(false);
+        send();
+    }
+
+    void send() {
+        if (++served_ >= config_.max_requests || g_should_exit) {
+            res_->keep_alive(false);
+        }
 
-        std::cout << "HTTP server running on port 8080..." << std::endl;
+        stream_.expires_after(config_.read_timeout);
+        http::async_write(stream_, *res_, beast::bind_front_handler(&Session::on_write, shared_from_this()));
+    }
 
-        while (!g_should_exit) {
-            tcp::socket socket{ioc};
+    void on_write(beast::error_code ec, std::size_t) {
+        if (ec) return fail(ec, "write");
+        if (!res_->keep_alive()) return do_close();
+        do_read();
+    }
+
+    void do_close() {
+        beast::error_code ec;
+        stream_.socket().shutdown(tcp::socket::shutdown_send, ec); // NOLINT
+    }
+
+    static void fail(beast::error_code ec, const char *what) {
+        if (!g_should_exit && ec != http::error::partial_message && ec != net::error::operation_aborted) {
+            std::cerr << "Session error (" << what << "): " << ec.message() << std::endl;
+        }
+    }
+};
+
+
+class Listener : public std::enable_shared_from_this<Listener> {
+public:
+    Listener(net::io_context &ioc, const tcp::endpoint &endpoint, const ServerConfig &config,
+             std::shared_ptr<const Router> router)
+            : ioc_(ioc), acceptor_(net::make_strand(ioc)), config_(config), router_(std::move(router)) {
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(net::socket_base::reuse_address(true));
+        if (config_.reuse_port) {
+            acceptor_.set_option(net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        }
+        acceptor_.bind(endpoint);
+        acceptor_.listen(net::socket_base::max_listen_connections);
+    }
+
+    void run() {
+        do_accept();
+    }
+
+    void stop() {
+        net::post(acceptor_.get_executor(), [self = shared_from_this()]() {
             boost::system::error_code ec;
-            auto err = global_acceptor->accept(socket, ec);
-            (void) err;
+            self->acceptor_.close(ec); // NOLINT
+        });
+    }
 
-            if (ec == boost::asio::error::operation_aborted) break;
+private:
+    net::io_context &ioc_;
+    tcp::acceptor acceptor_;
+    const ServerConfig &config_;
+    std::shared_ptr<const Router> router_;
 
-            if (ec) {
-                std::cerr << "Accept error: " << ec.message() << std::endl;
-                continue;
-            }
+    void do_accept() {
+        acceptor_.async_accept(net::make_strand(ioc_),
+                               beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
+    }
+
+    void on_accept(beast::error_code ec, Stream::socket_type socket) {
+        if (ec == net::error::operation_aborted || !acceptor_.is_open()) return;
 
-            auto session = [sock = std::move(socket), route_map]() mutable {
-                do_session(std::move(sock), route_map);
-            };
-            std::lock_guard<std::mutex> lock(session_mutex);
-            session_threads.emplace_back(std::move(session));
+        if (ec) {
+            std::cerr << "Accept error: " << ec.message() << std::endl;
+        } else {
+            std::make_shared<Session>(std::move(socket), config_, router_)->run();
         }
+        do_accept();
+    }
+};
 
-        ioc.stop();
-        global_acceptor.reset();
 
-        {
-            std::lock_guard lock(session_mutex);
-            for (size_t i = 0; i < session_threads.size(); ++i) { // NOLINT ranged-for illegal
-                if (session_threads.at(i).joinable()) {
-                    session_threads.at(i).join();
-                }
-            }
+// Filled once in main() before any io thread starts
+std::vector<std::unique_ptr<net::io_context>> g_contexts;
+std::vector<std::shared_ptr<Listener>> g_listeners;
+std::unique_ptr<net::signal_set> g_signals;
+std::unique_ptr<net::steady_timer> g_drain_timer;
+
+constexpr auto shutdown_drain = std::chrono::seconds(1);
+
+// Stops accepting, lets in-flight requests finish, then stops the io threads
+// (idle keep-alive connections would otherwise hold them until idle_timeout)
+void request_shutdown() {
+    for (const auto &listener: g_listeners) {
+        listener->stop();
+    }
+    net::post(g_signals->get_executor(), []() {
+        boost::system::error_code ec;
+        g_signals->cancel(ec); // NOLINT
+        g_drain_timer->expires_after(shutdown_drain);
+        g_drain_timer->async_wait([](const boost::system::error_code &) {
+            for (const auto &ioc: g_contexts) ioc->stop();
+        });
+    });
+}
+
+
+int main() {
+    std::atexit(cleanup);
+
+    const ServerConfig config = ServerConfig::from_env();
+    if (config.shards) TodoManager::configure(config.shards);
+    TodoManager::configure_change_log(config.change_log);
+
+    auto router = std::make_shared<const Router>(views::registry);
+    std::cout << "Registered routes:" << std::endl;
+    std::vector<std::string> metric_labels(router->endpoint_count());
+    for (const auto &route: router->routes()) {
+        for (const auto &endpoint: route.methods) {
+            std::cout << http::to_string(endpoint.method) << " " << route.path << std::endl;
+            metric_labels[endpoint.id] = "route=\"" + route.path + "\",method=\"" + std::string(http::to_string(endpoint.method)) + "\"";
+        }
+    }
+    Metrics::instance().configure(std::move(metric_labels));
+
+    try {
+        TodoManager::open_storage(config.snapshot, config.wal);
+        if (config.expiry_grace) TodoManager::start_expiry(*config.expiry_grace, config.expiry_interval);
+
+        // reuse_port: N single-threaded contexts, each with its own acceptor;
+        // otherwise one context shared by N threads behind a single acceptor
+        const std::size_t context_count = config.reuse_port ? config.threads : 1;
+        const int hint = config.reuse_port ? 1 : static_cast<int>(config.threads);
+
+        g_contexts.reserve(context_count);
+        const tcp::endpoint endpoint{tcp::v4(), config.port};
+        for (std::size_t i = 0; i < context_count; ++i) {
+            auto &ioc = *g_contexts.emplace_back(std::make_unique<net::io_context>(hint));
+            g_listeners.emplace_back(std::make_shared<Listener>(ioc, endpoint, config, router));
         }
 
+        g_signals = std::make_unique<net::signal_set>(*g_contexts.front(), SIGINT, SIGTERM);
+        g_drain_timer = std::make_unique<net::steady_timer>(*g_contexts.front());
+        g_signals->async_wait([](const boost::system::error_code &ec, int) {
+            if (ec) return;
+            g_should_exit = true;
+            request_shutdown();
+        });
+
+        for (const auto &listener: g_listeners) {
+            listener->run();
+        }
+
+        std::vector<std::thread> io_threads;
+        io_threads.reserve(config.threads);
+        for (std::size_t i = 0; i < config.threads; ++i) {
+            auto &ioc = *g_contexts[i % context_count];
+            io_threads.emplace_back([&ioc]() { ioc.run(); });
+        }
+
+        std::cout << "HTTP server running on port " << config.port
+                  << " with " << config.threads << " threads"
+                  << (config.reuse_port ? " (SO_REUSEPORT)" : "") << "..." << std::endl;
+
+        for (auto &t: io_threads) {
+            t.join();
+        }
+
+        g_listeners.clear();
+        g_drain_timer.reset();
+        g_signals.reset();
+        CsvImportBody::Job::drain();
+        g_contexts.clear();
+        TodoManager::stop_expiry();
+        TodoManager::close_storage();
+
         std::cout << "\U0001F44B Server exiting, cleaning up...\n";
 
     } catch (std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        TodoManager::stop_expiry();
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}